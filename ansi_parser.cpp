@@ -0,0 +1,255 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+#include "ansi_parser.hpp"
+
+#include <algorithm>
+
+
+namespace
+{
+
+constexpr auto ESC = '\x1b';
+constexpr auto BEL = '\x07';
+
+// The basic colors, a bit brighter than xterm's so that they are readable
+// on a dark background. Black is made gray for the same reason.
+constexpr std::uint32_t BASIC_COLORS[16] = {
+  0x767676, 0xe05050, 0x50c050, 0xd0c040,
+  0x5080f0, 0xc060c0, 0x40c0c0, 0xd0d0d0,
+  0x9a9a9a, 0xff7070, 0x70f070, 0xffff70,
+  0x80a8ff, 0xff80ff, 0x70ffff, 0xffffff,
+};
+
+constexpr std::uint8_t CUBE_LEVELS[6] = {0, 95, 135, 175, 215, 255};
+
+
+std::uint8_t cubeIndex(const int value)
+{
+  return value < 48 ? 0 : value < 115 ? 1 : std::uint8_t(std::min((value - 35) / 40, 5));
+}
+
+}
+
+
+std::uint32_t ansiPaletteColor(const std::uint8_t index)
+{
+  if (index < 16)
+  {
+    return BASIC_COLORS[index];
+  }
+
+  // 6x6x6 color cube, followed by 24 shades of gray
+  if (index < 232)
+  {
+    const auto cube = index - 16;
+    return
+      std::uint32_t(CUBE_LEVELS[cube / 36]) << 16 |
+      std::uint32_t(CUBE_LEVELS[cube / 6 % 6]) << 8 |
+      CUBE_LEVELS[cube % 6];
+  }
+
+  const auto gray = std::uint32_t(8 + (index - 232) * 10);
+  return gray << 16 | gray << 8 | gray;
+}
+
+
+const char* AnsiParser::parseEscape(const char* p, const char* const pEnd)
+{
+  for (; p < pEnd && mState != State::Text; ++p)
+  {
+    const auto c = *p;
+    switch (mState)
+    {
+      case State::Escape:
+        if (c == '[')
+        {
+          mState = State::Csi;
+          mParams.fill(0);
+          mParamCount = 0;
+          mIsPrivateCsi = false;
+        }
+        else if (c == ']' || c == 'P' || c == '_' || c == '^' || c == 'X')
+        {
+          // OSC, DCS etc. carry a string up to a terminator.
+          mState = State::String;
+        }
+        else if (c >= 0x20 && c <= 0x2f)
+        {
+          mState = State::EscapeIntermediate;
+        }
+        else if (c != ESC)
+        {
+          mState = State::Text;
+        }
+        break;
+
+      case State::EscapeIntermediate:
+        if (c < 0x20 || c > 0x2f)
+        {
+          mState = State::Text;
+        }
+        break;
+
+      case State::Csi:
+        if (c >= '0' && c <= '9')
+        {
+          // The first digit starts the first parameter.
+          mParamCount = std::max<std::size_t>(mParamCount, 1);
+          if (mParamCount <= MAX_PARAMS)
+          {
+            auto& param = mParams[mParamCount - 1];
+            param = std::uint16_t(std::min(param * 10 + (c - '0'), 0xffff));
+          }
+        }
+        else if (c == ';' || c == ':')
+        {
+          // An empty parameter counts as 0.
+          mParamCount = std::max<std::size_t>(mParamCount, 1) + 1;
+        }
+        else if (c >= '<' && c <= '?')
+        {
+          mIsPrivateCsi = true;
+        }
+        else if (c >= 0x40 && c <= 0x7e)
+        {
+          if (c == 'm' && !mIsPrivateCsi)
+          {
+            applySgr();
+          }
+
+          mState = State::Text;
+        }
+        else if (c == ESC)
+        {
+          mState = State::Escape;
+        }
+        break;
+
+      case State::String:
+        if (c == BEL)
+        {
+          mState = State::Text;
+        }
+        else if (c == ESC)
+        {
+          mState = State::StringEscape;
+        }
+        break;
+
+      case State::StringEscape:
+        mState = c == '\\' ? State::Text : State::String;
+        break;
+
+      case State::Text:
+        break;
+    }
+  }
+
+  return p;
+}
+
+
+void AnsiParser::applySgr()
+{
+  const auto count = std::min(mParamCount, MAX_PARAMS);
+
+  // No parameters at all means reset.
+  if (count == 0)
+  {
+    mForeground = -1;
+    mIsBold = false;
+  }
+
+  for (auto i = std::size_t{0}; i < count; ++i)
+  {
+    const auto param = mParams[i];
+    if (param == 0)
+    {
+      mForeground = -1;
+      mIsBold = false;
+    }
+    else if (param == 1)
+    {
+      mIsBold = true;
+    }
+    else if (param == 22)
+    {
+      mIsBold = false;
+    }
+    else if (param >= 30 && param <= 37)
+    {
+      mForeground = param - 30;
+    }
+    else if (param == 39)
+    {
+      mForeground = -1;
+    }
+    else if (param >= 90 && param <= 97)
+    {
+      mForeground = param - 90 + 8;
+    }
+    else if ((param == 38 || param == 48) && i + 1 < count)
+    {
+      // Extended colors: 5;index or 2;r;g;b. Background colors are
+      // skipped over the same way.
+      auto color = -1;
+      if (mParams[i + 1] == 5 && i + 2 < count)
+      {
+        color = mParams[i + 2] & 0xff;
+        i += 2;
+      }
+      else if (mParams[i + 1] == 2 && i + 4 < count)
+      {
+        color = 16 +
+          36 * cubeIndex(mParams[i + 2]) +
+          6 * cubeIndex(mParams[i + 3]) +
+          cubeIndex(mParams[i + 4]);
+        i += 4;
+      }
+      else
+      {
+        break;
+      }
+
+      if (param == 38)
+      {
+        mForeground = color;
+      }
+    }
+  }
+
+  updateStyle();
+}
+
+
+void AnsiParser::updateStyle()
+{
+  if (mForeground < 0)
+  {
+    mStyle = 0;
+    return;
+  }
+
+  const auto color = mIsBold && mForeground < 8 ? mForeground + 8 : mForeground;
+  mStyle = ANSI_STYLE | StyleId(color);
+}
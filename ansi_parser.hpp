@@ -0,0 +1,115 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+#pragma once
+
+#include "style_spans.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+/** Styles set by ANSI escape sequences have this bit set, with the index of
+  * the text color in the 256 color xterm palette in the low byte.
+  */
+constexpr auto ANSI_STYLE = StyleId{0x8000};
+
+constexpr bool isAnsiStyle(const StyleId style)
+{
+  return (style & ANSI_STYLE) != 0;
+}
+
+/** Color of the given palette entry, as 0xRRGGBB. */
+std::uint32_t ansiPaletteColor(std::uint8_t index);
+
+
+/** Strips ANSI escape sequences from text, and turns the colors set by SGR
+  * ("select graphic rendition") sequences into styles.
+  *
+  * Text is fed in as it arrives, in chunks of any size. A sequence split
+  * across chunks is picked up where it left off. Parsing takes linear time,
+  * and plain text between sequences is passed through in whole runs.
+  *
+  * Only text colors are supported. Bold turns the eight basic colors into
+  * their bright variants, like most terminals do. Everything else, like
+  * background colors or cursor movement, is dropped.
+  */
+class AnsiParser {
+public:
+  /** Call emit(pBegin, pEnd, style) for each run of text between escape
+    * sequences. The style is 0 if no color is set.
+    */
+  template <typename F>
+  void parse(const char* p, const char* const pEnd, F&& emit)
+  {
+    while (p < pEnd)
+    {
+      if (mState != State::Text)
+      {
+        p = parseEscape(p, pEnd);
+        continue;
+      }
+
+      const auto pEscape = static_cast<const char*>(std::memchr(p, '\x1b', pEnd - p));
+      const auto pTextEnd = pEscape ? pEscape : pEnd;
+      if (pTextEnd > p)
+      {
+        emit(p, pTextEnd, mStyle);
+      }
+
+      if (!pEscape)
+      {
+        break;
+      }
+
+      mState = State::Escape;
+      p = pEscape + 1;
+    }
+  }
+
+private:
+  enum class State {
+    Text,
+    Escape,
+    EscapeIntermediate,
+    Csi,
+    String,
+    StringEscape
+  };
+
+  const char* parseEscape(const char* p, const char* pEnd);
+  void applySgr();
+  void updateStyle();
+
+  static constexpr auto MAX_PARAMS = std::size_t{16};
+
+  State mState = State::Text;
+  std::array<std::uint16_t, MAX_PARAMS> mParams{};
+  std::size_t mParamCount = 0;
+  bool mIsPrivateCsi = false;
+
+  int mForeground = -1;
+  bool mIsBold = false;
+  StyleId mStyle = 0;
+};
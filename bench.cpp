@@ -0,0 +1,402 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+/** Headless benchmark for the text pipeline.
+  *
+  * Feeds generated and given files, as well as bursty script output, into
+  * a View and scrolls through them, without a display or renderer. Each
+  * corpus runs in a process of its own, so that peak memory use can be
+  * told apart.
+  */
+
+#include "decompressor.hpp"
+#include "font_atlas.hpp"
+#include "view.hpp"
+
+#include "imgui.h"
+
+#include <cxxopts.hpp>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+constexpr auto FONT_PATH = "/storage/.config/retroarch/regular.ttf";
+constexpr auto DEFAULT_FONT_SIZE = 50;
+
+// Same as the viewer's default --cache_mb, split the same way
+constexpr auto LINE_CACHE_SIZE = std::size_t{8 * 1024 * 1024};
+constexpr auto MAX_MAPPED_SIZE = std::size_t{8 * 1024 * 1024};
+
+constexpr auto DISPLAY_WIDTH = 1280.0f;
+constexpr auto DISPLAY_HEIGHT = 720.0f;
+
+// Frames spent scrolling down, and the same again scrolling back up
+constexpr auto SCROLL_FRAMES = 300;
+
+// Corpora which take longer than this to load count as failed.
+constexpr auto LOAD_TIMEOUT = std::chrono::minutes{2};
+
+// Output in bursts, with pauses in between, like a build log
+constexpr auto BURST_SCRIPT =
+  "for i in $(seq 1 20); do seq $((i * 10000)) $((i * 10000 + 9999)); sleep 0.1; done";
+
+using Clock = std::chrono::steady_clock;
+
+
+struct Corpus {
+  std::string name;
+  std::string pathOrCommand;
+  InputSource source;
+  bool wrapLines;
+};
+
+
+double millisecondsSince(const Clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+void writeFile(
+  const std::string& path,
+  const std::size_t size,
+  const std::function<std::string(std::size_t)>& makeLine)
+{
+  std::ofstream file(path, std::ios::binary);
+  auto written = std::size_t{0};
+  for (auto i = std::size_t{0}; written < size; ++i)
+  {
+    const auto line = makeLine(i);
+    file << line;
+    written += line.size();
+  }
+
+  if (!file)
+  {
+    throw std::runtime_error("Failed to write benchmark file");
+  }
+}
+
+
+std::string logLine(const std::size_t i)
+{
+  return
+    "2021-06-01 12:34:56.789 [info] worker " + std::to_string(i % 16) +
+    ": processed request " + std::to_string(i) +
+    " in " + std::to_string(i % 997) + " ms\n";
+}
+
+
+std::string longLine(std::size_t)
+{
+  static const auto line = []()
+  {
+    auto text = std::string{};
+    while (text.size() < 64 * 1024)
+    {
+      text += "lorem ipsum dolor sit amet, consectetur adipiscing elit ";
+    }
+
+    return text + '\n';
+  }();
+
+  return line;
+}
+
+
+std::string cjkLine(std::size_t)
+{
+  return "日志查看器可以显示很长的文本文件。これはテスト用の文章です。한국어 텍스트도 포함됩니다.\n";
+}
+
+
+void runFrames(
+  View& view,
+  DynamicFontAtlas& fontAtlas,
+  const int count,
+  std::vector<double>& frameTimes)
+{
+  auto& io = ImGui::GetIO();
+  for (auto i = 0; i < count; ++i)
+  {
+    view.update();
+
+    // There's no renderer with a font texture to recreate.
+    if (fontAtlas.needsRebuild())
+    {
+      fontAtlas.rebuild();
+      view.invalidateLayout();
+    }
+
+    const auto frameStart = Clock::now();
+    io.DisplaySize = {DISPLAY_WIDTH, DISPLAY_HEIGHT};
+    io.DeltaTime = 1.0f / 60.0f;
+    ImGui::NewFrame();
+    view.draw(io.DisplaySize);
+    ImGui::Render();
+    frameTimes.push_back(millisecondsSince(frameStart));
+  }
+}
+
+
+void benchmarkCorpus(
+  const Corpus& corpus,
+  const std::string& fontPath,
+  const int fontSize)
+{
+  ImGui::CreateContext();
+  auto& io = ImGui::GetIO();
+  io.IniFilename = nullptr;
+  io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
+  io.BackendFlags |= ImGuiBackendFlags_HasGamepad;
+
+  {
+    auto fontAtlas = DynamicFontAtlas{io.Fonts, fontPath, float(fontSize)};
+
+    const auto loadStart = Clock::now();
+    auto text = corpus.source == InputSource::ScriptFile
+      ? TextBuffer{corpus.pathOrCommand}
+      : TextBuffer::mapFile(corpus.pathOrCommand, MAX_MAPPED_SIZE);
+    const auto source =
+      corpus.source == InputSource::Text &&
+      detectCompression(text) != Compression::None
+      ? InputSource::CompressedFile
+      : corpus.source;
+    const auto fileSize = text.size();
+
+    auto view = View{
+      corpus.name,
+      std::move(text),
+      false,
+      corpus.wrapLines,
+      source,
+      std::nullopt,
+      true,
+      ScrollbackLimits{},
+      LINE_CACHE_SIZE,
+      MAX_MAPPED_SIZE,
+      {},
+      []() {},
+      nullptr,
+      &fontAtlas};
+
+    // Frames keep being drawn while loading, as they would be on screen.
+    std::vector<double> frameTimes;
+    do
+    {
+      runFrames(view, fontAtlas, 1, frameTimes);
+      if (Clock::now() - loadStart > LOAD_TIMEOUT)
+      {
+        throw std::runtime_error("Timed out loading " + corpus.name);
+      }
+    }
+    while (view.isLoading());
+
+    const auto loadMs = millisecondsSince(loadStart);
+    const auto bytes = source == InputSource::Text ? fileSize : view.bytesIngested();
+
+    // Scroll down at full speed, then back up.
+    frameTimes.clear();
+    io.NavInputs[ImGuiNavInput_TweakFast] = 1.0f;
+    io.NavInputs[ImGuiNavInput_LStickDown] = 1.0f;
+    runFrames(view, fontAtlas, SCROLL_FRAMES, frameTimes);
+    io.NavInputs[ImGuiNavInput_LStickDown] = 0.0f;
+    io.NavInputs[ImGuiNavInput_LStickUp] = 1.0f;
+    runFrames(view, fontAtlas, SCROLL_FRAMES, frameTimes);
+
+    const auto averageFrameMs =
+      std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / frameTimes.size();
+    const auto maxFrameMs = *std::max_element(frameTimes.begin(), frameTimes.end());
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::printf(
+      "%-24s %10.1f %10.1f %10.3f %10.3f %10.1f\n",
+      corpus.name.c_str(),
+      loadMs,
+      bytes / 1e6 / std::max(loadMs / 1000.0, 1e-6),
+      averageFrameMs,
+      maxFrameMs,
+      usage.ru_maxrss / 1024.0);
+  }
+
+  ImGui::DestroyContext();
+}
+
+
+bool runInChildProcess(const std::function<void()>& func)
+{
+  // Anything still buffered would be written twice otherwise.
+  std::fflush(stdout);
+
+  const auto pid = fork();
+  if (pid == -1)
+  {
+    throw std::runtime_error("Failed to fork()");
+  }
+
+  if (pid == 0)
+  {
+    auto exitCode = 0;
+    try
+    {
+      func();
+    }
+    catch (const std::exception& error)
+    {
+      std::cerr << "Error: " << error.what() << '\n';
+      exitCode = 1;
+    }
+
+    std::fflush(stdout);
+    std::_Exit(exitCode);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+int run(const cxxopts::ParseResult& args)
+{
+  const auto fontPath = args.count("font")
+    ? args["font"].as<std::string>()
+    : std::string{FONT_PATH};
+  const auto fontSize = args.count("font_size")
+    ? args["font_size"].as<int>()
+    : DEFAULT_FONT_SIZE;
+
+  char directoryTemplate[] = "/tmp/text_viewer_bench.XXXXXX";
+  const auto pDirectory = mkdtemp(directoryTemplate);
+  if (!pDirectory)
+  {
+    throw std::runtime_error("Failed to create directory for benchmark files");
+  }
+
+  const auto directory = std::string{pDirectory};
+  std::vector<std::string> generatedFiles;
+  auto generate = [&](
+    const std::string& name,
+    const std::size_t size,
+    const std::function<std::string(std::size_t)>& makeLine)
+  {
+    const auto path = directory + "/" + name;
+    generatedFiles.push_back(path);
+    writeFile(path, size, makeLine);
+    return path;
+  };
+
+  std::vector<Corpus> corpora{
+    {"log_1mb", generate("log_1mb.txt", 1024 * 1024, logLine), InputSource::Text, false},
+    {"log_100mb", generate("log_100mb.txt", 100 * 1024 * 1024, logLine), InputSource::Text, false},
+    {"long_lines_wrapped", generate("long_lines.txt", 16 * 1024 * 1024, longLine), InputSource::Text, true},
+    {"cjk_8mb", generate("cjk.txt", 8 * 1024 * 1024, cjkLine), InputSource::Text, false},
+    {"script_bursts", BURST_SCRIPT, InputSource::ScriptFile, false},
+  };
+
+  if (args.count("files"))
+  {
+    for (const auto& path : args["files"].as<std::vector<std::string>>())
+    {
+      corpora.push_back({path, path, InputSource::Text, false});
+    }
+  }
+
+  std::printf(
+    "%-24s %10s %10s %10s %10s %10s\n",
+    "corpus",
+    "load ms",
+    "MB/s",
+    "frame ms",
+    "max ms",
+    "peak MB");
+
+  auto allSucceeded = true;
+  for (const auto& corpus : corpora)
+  {
+    allSucceeded &= runInChildProcess(
+      [&]() { benchmarkCorpus(corpus, fontPath, fontSize); });
+  }
+
+  for (const auto& path : generatedFiles)
+  {
+    std::remove(path.c_str());
+  }
+  rmdir(directory.c_str());
+
+  return allSucceeded ? 0 : 1;
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+  try
+  {
+    cxxopts::Options options(argv[0], "Headless benchmark for TvTextViewer");
+
+    options
+      .positional_help("[files...]")
+      .show_positional_help()
+      .add_options()
+        ("files", "additional files to benchmark", cxxopts::value<std::vector<std::string>>())
+        ("font", "TrueType font to use (default: the viewer's font)", cxxopts::value<std::string>())
+        ("f,font_size", "font size in pixels", cxxopts::value<int>())
+        ("h,help", "show help")
+      ;
+
+    options.parse_positional({"files"});
+
+    const auto args = options.parse(argc, argv);
+    if (args.count("help"))
+    {
+      std::cout << options.help({""}) << '\n';
+      return 0;
+    }
+
+    return run(args);
+  }
+  catch (const std::exception& error)
+  {
+    std::cerr << "Error: " << error.what() << '\n';
+    return -1;
+  }
+}
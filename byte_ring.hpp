@@ -0,0 +1,133 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+
+/** Lock-free single producer, single consumer ring buffer of bytes.
+  *
+  * The producer writes directly into free space obtained from writable(),
+  * the consumer reads directly out of readable(), so no copies are made
+  * on the way through. Capacity must be a power of two.
+  *
+  * When the ring is full, the producer can block in waitForSpace() until
+  * the consumer frees some. The consumer only pays for waking it up while
+  * it's actually waiting.
+  */
+class ByteRing {
+public:
+  explicit ByteRing(const std::size_t capacity)
+    : mpData(new char[capacity])
+    , mCapacity(capacity)
+  {
+    assert((capacity & (capacity - 1)) == 0);
+  }
+
+  /** Contiguous free space. Producer only. */
+  std::pair<char*, std::size_t> writable() const
+  {
+    const auto writePos = mWritePos.load(std::memory_order_relaxed);
+    const auto readPos = mReadPos.load(std::memory_order_acquire);
+    const auto offset = writePos & (mCapacity - 1);
+    const auto freeSize = mCapacity - (writePos - readPos);
+    return {mpData.get() + offset, std::min(freeSize, mCapacity - offset)};
+  }
+
+  /** Publish size bytes written to the space from writable(). */
+  void commitWrite(const std::size_t size)
+  {
+    mWritePos.store(
+      mWritePos.load(std::memory_order_relaxed) + size,
+      std::memory_order_release);
+  }
+
+  /** Contiguous data ready to be read. Consumer only. */
+  std::pair<const char*, std::size_t> readable() const
+  {
+    const auto readPos = mReadPos.load(std::memory_order_relaxed);
+    const auto writePos = mWritePos.load(std::memory_order_acquire);
+    const auto offset = readPos & (mCapacity - 1);
+    const auto usedSize = writePos - readPos;
+    return {mpData.get() + offset, std::min(usedSize, mCapacity - offset)};
+  }
+
+  /** Release size bytes obtained from readable() back to the producer. */
+  void commitRead(const std::size_t size)
+  {
+    mReadPos.store(
+      mReadPos.load(std::memory_order_relaxed) + size,
+      std::memory_order_release);
+
+    // Pairs with the fence in waitForSpace(): Either the producer sees the
+    // space freed above, or we see that it's waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mProducerWaiting.load(std::memory_order_relaxed))
+    {
+      const auto lock = std::lock_guard{mMutex};
+      mSpaceFreed.notify_one();
+    }
+  }
+
+  /** Block until there is free space, or stopWaiting() was called.
+    * Producer only.
+    */
+  void waitForSpace()
+  {
+    auto lock = std::unique_lock{mMutex};
+    mProducerWaiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    mSpaceFreed.wait(lock, [this]() { return mStopWaiting || writable().second > 0; });
+    mProducerWaiting.store(false, std::memory_order_relaxed);
+  }
+
+  /** Make waitForSpace() return, now and from then on, e.g. to stop the
+    * producer.
+    */
+  void stopWaiting()
+  {
+    const auto lock = std::lock_guard{mMutex};
+    mStopWaiting = true;
+    mSpaceFreed.notify_one();
+  }
+
+private:
+  std::unique_ptr<char[]> mpData;
+  std::size_t mCapacity;
+
+  // Positions only ever increase, and are wrapped on access. Keep them on
+  // separate cache lines so the two threads don't contend.
+  alignas(64) std::atomic<std::size_t> mWritePos{0};
+  alignas(64) std::atomic<std::size_t> mReadPos{0};
+
+  std::atomic<bool> mProducerWaiting{false};
+  std::mutex mMutex;
+  std::condition_variable mSpaceFreed;
+  bool mStopWaiting = false;
+};
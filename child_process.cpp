@@ -0,0 +1,380 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "child_process.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+
+extern char** environ;
+
+
+namespace
+{
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+/** Write ends of the self-pipes of all children watched without a pidfd,
+  * offset by one, so that 0 marks a free slot. SIGCHLD doesn't say which
+  * child exited, so the handler wakes up all watchers.
+  */
+constexpr auto MAX_SIGNAL_PIPES = std::size_t{64};
+std::atomic<int> sSignalPipes[MAX_SIGNAL_PIPES];
+
+
+void onChildSignal(int)
+{
+  const auto savedErrno = errno;
+  for (const auto& slot : sSignalPipes)
+  {
+    const auto fd = slot.load() - 1;
+    if (fd >= 0)
+    {
+      const char byte = 0;
+      [[maybe_unused]] const auto result = write(fd, &byte, 1);
+    }
+  }
+  errno = savedErrno;
+}
+
+
+bool registerSignalPipe(const int fd)
+{
+  static std::once_flag handlerInstalled;
+  std::call_once(handlerInstalled, []()
+  {
+    struct sigaction action{};
+    action.sa_handler = onChildSignal;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, nullptr);
+  });
+
+  for (auto& slot : sSignalPipes)
+  {
+    auto expected = 0;
+    if (slot.compare_exchange_strong(expected, fd + 1))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+void unregisterSignalPipe(const int fd)
+{
+  for (auto& slot : sSignalPipes)
+  {
+    auto expected = fd + 1;
+    slot.compare_exchange_strong(expected, 0);
+  }
+}
+
+class SpawnSetup {
+public:
+  SpawnSetup()
+  {
+    posix_spawn_file_actions_init(&mFileActions);
+    posix_spawnattr_init(&mAttributes);
+  }
+
+  ~SpawnSetup()
+  {
+    posix_spawnattr_destroy(&mAttributes);
+    posix_spawn_file_actions_destroy(&mFileActions);
+  }
+
+  SpawnSetup(const SpawnSetup&) = delete;
+  SpawnSetup& operator=(const SpawnSetup&) = delete;
+
+  posix_spawn_file_actions_t mFileActions;
+  posix_spawnattr_t mAttributes;
+};
+
+}
+
+
+ChildProcess::ChildProcess(
+  const std::string& command,
+  const bool killOnExit,
+  std::function<void()> onExit)
+  : mPid(-1)
+  , mOutputFd(-1)
+  , mErrorFd(-1)
+  , mKillOnExit(killOnExit)
+  , mOnExit(std::move(onExit))
+  , mPidFd(-1)
+  , mSignalPipe{-1, -1}
+  , mStopEventFd(-1)
+{
+  int outputPipe[2];
+  int errorPipe[2];
+  if (pipe2(outputPipe, O_CLOEXEC) == -1)
+  {
+    throw std::runtime_error("Failed to create pipe for script");
+  }
+
+  if (pipe2(errorPipe, O_CLOEXEC) == -1)
+  {
+    close(outputPipe[0]);
+    close(outputPipe[1]);
+    throw std::runtime_error("Failed to create pipe for script");
+  }
+
+  SpawnSetup setup;
+
+  // dup2() clears O_CLOEXEC on the copies, everything else is closed on
+  // exec.
+  posix_spawn_file_actions_adddup2(&setup.mFileActions, outputPipe[1], STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&setup.mFileActions, errorPipe[1], STDERR_FILENO);
+
+  // Don't pass our signal setup on to the script.
+  sigset_t noSignals;
+  sigemptyset(&noSignals);
+  posix_spawnattr_setsigmask(&setup.mAttributes, &noSignals);
+
+  sigset_t defaultSignals;
+  sigemptyset(&defaultSignals);
+  for (const auto signal : {SIGPIPE, SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGCHLD})
+  {
+    sigaddset(&defaultSignals, signal);
+  }
+  posix_spawnattr_setsigdefault(&setup.mAttributes, &defaultSignals);
+
+  auto flags = short{POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF};
+
+  // A process group of its own lets us terminate the script along with
+  // anything it started.
+  if (mKillOnExit)
+  {
+    flags |= POSIX_SPAWN_SETPGROUP;
+    posix_spawnattr_setpgroup(&setup.mAttributes, 0);
+  }
+
+  posix_spawnattr_setflags(&setup.mAttributes, flags);
+
+  char shell[] = "/bin/sh";
+  char option[] = "-c";
+  char* argv[] = {shell, option, const_cast<char*>(command.c_str()), nullptr};
+
+  const auto result = posix_spawn(
+    &mPid, shell, &setup.mFileActions, &setup.mAttributes, argv, environ);
+  close(outputPipe[1]);
+  close(errorPipe[1]);
+
+  if (result != 0)
+  {
+    close(outputPipe[0]);
+    close(errorPipe[0]);
+    throw std::runtime_error("Failed to execute script");
+  }
+
+  mOutputFd = outputPipe[0];
+  mErrorFd = errorPipe[0];
+
+  if (mOnExit)
+  {
+    startWatcher();
+  }
+}
+
+
+ChildProcess::~ChildProcess()
+{
+  if (mWatcherThread.joinable())
+  {
+    const std::uint64_t value = 1;
+    write(mStopEventFd, &value, sizeof(value));
+    mWatcherThread.join();
+  }
+
+  if (mSignalPipe[0] != -1)
+  {
+    unregisterSignalPipe(mSignalPipe[1]);
+    close(mSignalPipe[0]);
+    close(mSignalPipe[1]);
+  }
+
+  for (const auto fd : {mPidFd, mStopEventFd})
+  {
+    if (fd != -1)
+    {
+      close(fd);
+    }
+  }
+
+  closeOutput();
+
+  if (mKillOnExit && !exitStatus())
+  {
+    kill(-mPid, SIGTERM);
+  }
+
+  // Collect the exit status if it's available already, but don't wait.
+  exitStatus();
+}
+
+
+void ChildProcess::closeOutput()
+{
+  for (const auto pFd : {&mOutputFd, &mErrorFd})
+  {
+    if (*pFd != -1)
+    {
+      close(*pFd);
+      *pFd = -1;
+    }
+  }
+}
+
+
+std::optional<int> ChildProcess::exitStatus()
+{
+  if (mExitStatus)
+  {
+    return mExitStatus;
+  }
+
+  int status = 0;
+  if (waitpid(mPid, &status, WNOHANG) == mPid)
+  {
+    if (WIFEXITED(status))
+    {
+      mExitStatus = WEXITSTATUS(status);
+    }
+    else if (WIFSIGNALED(status))
+    {
+      mExitStatus = 128 + WTERMSIG(status);
+    }
+  }
+
+  return mExitStatus;
+}
+
+
+bool ChildProcess::hasExited() const
+{
+  return mExited.load(std::memory_order_acquire);
+}
+
+
+void ChildProcess::startWatcher()
+{
+  // Without the watcher, the child is still reaped whenever someone asks
+  // for its exit status, so failing here isn't fatal.
+  mStopEventFd = eventfd(0, EFD_CLOEXEC);
+  if (mStopEventFd == -1)
+  {
+    return;
+  }
+
+  // The child can't have been reaped yet, so the pid still refers to it.
+  mPidFd = int(syscall(SYS_pidfd_open, mPid, 0));
+  if (mPidFd == -1)
+  {
+    if (pipe2(mSignalPipe, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+      mSignalPipe[0] = mSignalPipe[1] = -1;
+      return;
+    }
+
+    if (!registerSignalPipe(mSignalPipe[1]))
+    {
+      close(mSignalPipe[0]);
+      close(mSignalPipe[1]);
+      mSignalPipe[0] = mSignalPipe[1] = -1;
+      return;
+    }
+  }
+
+  mWatcherThread = std::thread([this]() { watchLoop(); });
+}
+
+
+bool ChildProcess::hasTerminated() const
+{
+  // Only look, reaping is left to exitStatus() on the UI thread.
+  siginfo_t info{};
+  return
+    waitid(P_PID, id_t(mPid), &info, WEXITED | WNOHANG | WNOWAIT) == 0 &&
+    info.si_pid == mPid;
+}
+
+
+void ChildProcess::watchLoop()
+{
+  const auto exitFd = mPidFd != -1 ? mPidFd : mSignalPipe[0];
+
+  // The child might have exited before the SIGCHLD handler was installed.
+  while (mPidFd != -1 || !hasTerminated())
+  {
+    struct pollfd pollData[] = {
+      {exitFd, POLLIN, 0},
+      {mStopEventFd, POLLIN, 0}
+    };
+
+    if (poll(pollData, 2, -1) == -1)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      return;
+    }
+
+    if (pollData[1].revents != 0)
+    {
+      return;
+    }
+
+    // A pidfd becomes readable when the child exits.
+    if (mPidFd != -1)
+    {
+      break;
+    }
+
+    char buffer[64];
+    while (read(mSignalPipe[0], buffer, sizeof(buffer)) > 0)
+    {
+    }
+  }
+
+  mExited.store(true, std::memory_order_release);
+  mOnExit();
+}
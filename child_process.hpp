@@ -0,0 +1,97 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+
+
+/** A shell command running in a child process.
+  *
+  * The child is started with posix_spawn(), which avoids copying our page
+  * tables the way fork() would. Its stdout and stderr go into separate
+  * pipes which we read from.
+  *
+  * Nothing ever waits for the child to exit. exitStatus() reaps it if it
+  * is done, but returns immediately otherwise. A child which is still
+  * running when we exit is left to init.
+  *
+  * When given a callback, a background thread watches for the child's
+  * exit and calls it, so that the UI thread can reap the child right away
+  * instead of polling. The thread waits on a pidfd, or on a SIGCHLD
+  * self-pipe with kernels older than 5.3, which don't have pidfds.
+  */
+class ChildProcess {
+public:
+  /** Start the command. With killOnExit, the child gets its own process
+    * group, which is terminated when this object is destroyed. Throws on
+    * failure.
+    */
+  ChildProcess(
+    const std::string& command,
+    bool killOnExit,
+    std::function<void()> onExit = {});
+  ~ChildProcess();
+
+  ChildProcess(const ChildProcess&) = delete;
+  ChildProcess& operator=(const ChildProcess&) = delete;
+
+  /** Read ends of the pipes receiving the child's stdout and stderr, -1
+    * once closed
+    */
+  int outputFd() const { return mOutputFd; }
+  int errorFd() const { return mErrorFd; }
+
+  void closeOutput();
+
+  /** Exit status if the child has exited, 128 + signal number if it was
+    * killed by a signal (like the shell reports it).
+    */
+  std::optional<int> exitStatus();
+
+  /** True once the watcher thread saw the child exit. exitStatus() then
+    * won't return std::nullopt anymore.
+    */
+  bool hasExited() const;
+
+private:
+  void startWatcher();
+  void watchLoop();
+  bool hasTerminated() const;
+
+  pid_t mPid;
+  int mOutputFd;
+  int mErrorFd;
+  bool mKillOnExit;
+  std::optional<int> mExitStatus;
+  std::function<void()> mOnExit;
+  std::atomic<bool> mExited{false};
+  int mPidFd;
+  int mSignalPipe[2];
+  int mStopEventFd;
+  std::thread mWatcherThread;
+};
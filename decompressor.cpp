@@ -0,0 +1,384 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "decompressor.hpp"
+
+#include <zlib.h>
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <utility>
+
+
+namespace
+{
+
+constexpr auto BUFFER_SIZE = std::size_t{1024 * 1024};
+
+// Amount of compressed data handed to the decompressor at once, which is
+// also the granularity of progress updates.
+constexpr auto INPUT_CHUNK_SIZE = std::size_t{256 * 1024};
+
+constexpr unsigned char GZIP_MAGIC[] = {0x1F, 0x8B};
+constexpr unsigned char ZSTD_MAGIC[] = {0x28, 0xB5, 0x2F, 0xFD};
+
+
+template <std::size_t N>
+bool startsWith(const char* pData, const std::size_t size, const unsigned char (&magic)[N])
+{
+  return size >= N && std::memcmp(pData, magic, N) == 0;
+}
+
+}
+
+
+Compression detectCompression(const TextBuffer& data)
+{
+  const auto range = data.range(
+    data.startOffset(),
+    std::min(data.endOffset(), data.startOffset() + sizeof(ZSTD_MAGIC)));
+  if (startsWith(range.data(), range.size(), GZIP_MAGIC))
+  {
+    return Compression::Gzip;
+  }
+
+  if (startsWith(range.data(), range.size(), ZSTD_MAGIC))
+  {
+    return Compression::Zstd;
+  }
+
+  return Compression::None;
+}
+
+
+Decompressor::Decompressor(
+  TextBuffer compressedData,
+  std::function<void()> onDataAvailable)
+  : mInput(std::move(compressedData))
+  , mCompression(detectCompression(mInput))
+  , mBuffer(BUFFER_SIZE)
+  , mOnDataAvailable(std::move(onDataAvailable))
+{
+  mThread = std::thread([this]() { decompressLoop(); });
+}
+
+
+Decompressor::~Decompressor()
+{
+  mStop.store(true);
+  mBuffer.stopWaiting();
+  mThread.join();
+}
+
+
+bool Decompressor::isFinished() const
+{
+  return mFinished.load(std::memory_order_acquire);
+}
+
+
+bool Decompressor::hasFailed() const
+{
+  return mFailed.load(std::memory_order_acquire);
+}
+
+
+float Decompressor::progress() const
+{
+  return mInput.empty()
+    ? 1.0f
+    : float(mInputConsumed.load(std::memory_order_relaxed)) / mInput.size();
+}
+
+
+void Decompressor::decompressLoop()
+{
+  const auto succeeded =
+    mCompression == Compression::Gzip ? inflateGzip() :
+    mCompression == Compression::Zstd ? decompressZstd() :
+    copyUncompressed();
+
+  mFailed.store(!succeeded && !mStop.load(), std::memory_order_release);
+  mFinished.store(true, std::memory_order_release);
+
+  // Let the UI thread know that we're done, so it doesn't need to poll for
+  // that either.
+  mNotificationPending.store(false);
+  notify();
+}
+
+
+bool Decompressor::copyUncompressed()
+{
+  const auto inputSize = mInput.size();
+  for (std::uint64_t consumed = 0; consumed < inputSize; )
+  {
+    mInputConsumed.store(consumed, std::memory_order_relaxed);
+
+    const auto [pFree, freeSize] = waitForSpace();
+    if (freeSize == 0)
+    {
+      return false;
+    }
+
+    const auto size = std::size_t(
+      std::min<std::uint64_t>({freeSize, INPUT_CHUNK_SIZE, inputSize - consumed}));
+    const auto range = inputRange(consumed, consumed + size);
+    if (!range)
+    {
+      return false;
+    }
+
+    std::memcpy(pFree, range->data(), size);
+    mBuffer.commitWrite(size);
+    notify();
+
+    // The text is only needed once, so it doesn't have to stay in memory.
+    mInput.releasePages(consumed, consumed + size);
+    consumed += size;
+  }
+
+  return true;
+}
+
+
+bool Decompressor::inflateGzip()
+{
+  z_stream stream{};
+
+  // Accept both gzip and zlib headers.
+  if (inflateInit2(&stream, 15 + 32) != Z_OK)
+  {
+    return false;
+  }
+
+  // The input is read a chunk at a time, so that the file doesn't need to
+  // be mapped as a whole.
+  const auto inputSize = mInput.size();
+  auto chunk = TextBuffer::Range{};
+  auto chunkOffset = std::uint64_t{0};
+  const auto consumedSize = [&]()
+  {
+    return chunkOffset + (stream.next_in - reinterpret_cast<const Bytef*>(chunk.data()));
+  };
+  stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(chunk.data()));
+
+  auto streamEnded = false;
+  auto succeeded = true;
+  while (succeeded)
+  {
+    const auto consumed = consumedSize();
+    mInputConsumed.store(consumed, std::memory_order_relaxed);
+
+    if (stream.avail_in == 0)
+    {
+      if (consumed == inputSize)
+      {
+        // Without the end of the last member, the file was cut short.
+        succeeded = streamEnded;
+        break;
+      }
+
+      auto nextChunk = inputRange(
+        consumed, std::min<std::uint64_t>(inputSize, consumed + INPUT_CHUNK_SIZE));
+      if (!nextChunk)
+      {
+        succeeded = false;
+        break;
+      }
+
+      chunk = std::move(*nextChunk);
+      chunkOffset = consumed;
+      stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(chunk.data()));
+      stream.avail_in = uInt(chunk.size());
+    }
+
+    const auto [pFree, freeSize] = waitForSpace();
+    if (freeSize == 0)
+    {
+      break;
+    }
+
+    stream.next_out = reinterpret_cast<Bytef*>(pFree);
+    stream.avail_out = uInt(freeSize);
+    const auto result = inflate(&stream, Z_NO_FLUSH);
+
+    const auto bytesWritten = freeSize - stream.avail_out;
+    if (bytesWritten > 0)
+    {
+      mBuffer.commitWrite(bytesWritten);
+      notify();
+    }
+
+    streamEnded = result == Z_STREAM_END;
+    if (streamEnded)
+    {
+      // Files written by e.g. "gzip -c >>" consist of several members.
+      if (consumedSize() < inputSize)
+      {
+        succeeded = inflateReset(&stream) == Z_OK;
+      }
+    }
+    else if (result != Z_OK && result != Z_BUF_ERROR)
+    {
+      succeeded = false;
+    }
+  }
+
+  inflateEnd(&stream);
+  return succeeded;
+}
+
+
+bool Decompressor::decompressZstd()
+{
+#if defined(HAVE_ZSTD)
+  const auto pStream = ZSTD_createDStream();
+  if (!pStream)
+  {
+    return false;
+  }
+
+  // Read a chunk at a time, same as for gzip
+  const auto inputSize = mInput.size();
+  auto chunk = TextBuffer::Range{};
+  auto chunkOffset = std::uint64_t{0};
+  ZSTD_inBuffer input{chunk.data(), 0, 0};
+
+  // Zero once a frame is complete, and all of its output was flushed
+  auto remainder = std::size_t{1};
+  auto succeeded = true;
+  while (succeeded)
+  {
+    const auto consumed = chunkOffset + input.pos;
+    mInputConsumed.store(consumed, std::memory_order_relaxed);
+
+    if (input.pos == input.size)
+    {
+      if (consumed < inputSize)
+      {
+        auto nextChunk = inputRange(
+          consumed, std::min<std::uint64_t>(inputSize, consumed + INPUT_CHUNK_SIZE));
+        if (!nextChunk)
+        {
+          succeeded = false;
+          break;
+        }
+
+        chunk = std::move(*nextChunk);
+        chunkOffset = consumed;
+        input = ZSTD_inBuffer{chunk.data(), chunk.size(), 0};
+      }
+      else if (remainder == 0)
+      {
+        break;
+      }
+    }
+
+    const auto [pFree, freeSize] = waitForSpace();
+    if (freeSize == 0)
+    {
+      break;
+    }
+
+    ZSTD_outBuffer output{pFree, freeSize, 0};
+    remainder = ZSTD_decompressStream(pStream, &output, &input);
+    if (ZSTD_isError(remainder))
+    {
+      succeeded = false;
+    }
+
+    if (output.pos > 0)
+    {
+      mBuffer.commitWrite(output.pos);
+      notify();
+    }
+
+    // Nothing left to flush, but the last frame isn't complete either, so
+    // the file was cut short.
+    if (
+      chunkOffset + input.pos == inputSize &&
+      remainder != 0 &&
+      output.pos == 0)
+    {
+      succeeded = false;
+    }
+  }
+
+  ZSTD_freeDStream(pStream);
+  return succeeded;
+#else
+  // Built without libzstd
+  return false;
+#endif
+}
+
+
+std::optional<TextBuffer::Range> Decompressor::inputRange(
+  const std::uint64_t begin,
+  const std::uint64_t end) const
+{
+  // Failing to map part of the input ends decompression like corrupt data
+  // does, instead of taking down the whole process from this thread.
+  try
+  {
+    return mInput.range(begin, end);
+  }
+  catch (const std::exception&)
+  {
+    return std::nullopt;
+  }
+}
+
+
+std::pair<char*, std::size_t> Decompressor::waitForSpace()
+{
+  // If the UI thread hasn't caught up yet, wait until it frees some space.
+  // Returns no space at all when asked to stop.
+  for (;;)
+  {
+    if (mStop.load())
+    {
+      return {nullptr, 0};
+    }
+
+    const auto writable = mBuffer.writable();
+    if (writable.second > 0)
+    {
+      return writable;
+    }
+
+    mBuffer.waitForSpace();
+  }
+}
+
+
+void Decompressor::notify()
+{
+  if (mOnDataAvailable && !mNotificationPending.exchange(true))
+  {
+    mOnDataAvailable();
+  }
+}
@@ -0,0 +1,133 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "byte_ring.hpp"
+#include "text_buffer.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <thread>
+
+
+enum class Compression {
+  None,
+  Gzip,
+  Zstd
+};
+
+
+/** Tell compressed data apart from text by its magic bytes. */
+Compression detectCompression(const TextBuffer& data);
+
+
+/** Decompresses a gzip or zstd file on a background thread.
+  *
+  * The compressed data is typically a mapped file, which is read front to
+  * back. Decompressed text is written into a ring buffer, from which the UI
+  * thread picks it up - same as StreamReader does for script output, so
+  * the decompressed text never needs to be held in memory as a whole.
+  * Concatenated gzip members and zstd frames are decompressed one after
+  * the other. Data which isn't compressed is passed on as is, so that text
+  * which needs converting can be streamed the same way.
+  *
+  * The UI thread is notified via the given callback when new text arrives,
+  * coalesced until the next call to consume().
+  */
+class Decompressor {
+public:
+  Decompressor(TextBuffer compressedData, std::function<void()> onDataAvailable);
+  ~Decompressor();
+
+  Decompressor(const Decompressor&) = delete;
+  Decompressor& operator=(const Decompressor&) = delete;
+
+  /** Hand all text decompressed so far to the given function.
+    *
+    * The function is called with (const char* pData, std::size_t size),
+    * possibly more than once. Returns the total number of bytes consumed.
+    */
+  template <typename Callback>
+  std::size_t consume(Callback&& callback)
+  {
+    // Clear this before looking at the buffer, so that anything written
+    // after we're done leads to another notification.
+    mNotificationPending.store(false);
+
+    std::size_t totalSize = 0;
+
+    for (;;)
+    {
+      const auto [pData, size] = mBuffer.readable();
+      if (size == 0)
+      {
+        break;
+      }
+
+      callback(pData, size);
+      mBuffer.commitRead(size);
+      totalSize += size;
+    }
+
+    return totalSize;
+  }
+
+  /** True once all data was decompressed, or decompression failed.
+    *
+    * All text decompressed up to that point can still be consume()d
+    * afterwards.
+    */
+  bool isFinished() const;
+
+  /** True if the data is corrupt or truncated, or the compression format
+    * isn't supported by this build.
+    */
+  bool hasFailed() const;
+
+  /** How much of the compressed data was decompressed so far, from 0 to 1 */
+  float progress() const;
+
+  Compression compression() const { return mCompression; }
+
+private:
+  void decompressLoop();
+  bool copyUncompressed();
+  bool inflateGzip();
+  bool decompressZstd();
+  std::pair<char*, std::size_t> waitForSpace();
+  std::optional<TextBuffer::Range> inputRange(std::uint64_t begin, std::uint64_t end) const;
+  void notify();
+
+  TextBuffer mInput;
+  Compression mCompression;
+  ByteRing mBuffer;
+  std::atomic<std::uint64_t> mInputConsumed{0};
+  std::atomic<bool> mStop{false};
+  std::atomic<bool> mFinished{false};
+  std::atomic<bool> mFailed{false};
+  std::atomic<bool> mNotificationPending{false};
+  std::function<void()> mOnDataAvailable;
+  std::thread mThread;
+};
@@ -0,0 +1,235 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "file_follower.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+
+namespace
+{
+
+constexpr auto CHUNK_SIZE = std::size_t{256 * 1024};
+
+
+std::string parentDirectory(const std::string& path)
+{
+  const auto pos = path.rfind('/');
+  if (pos == std::string::npos)
+  {
+    return ".";
+  }
+
+  return pos == 0 ? "/" : path.substr(0, pos);
+}
+
+}
+
+
+FileFollower::FileFollower(
+  std::string path,
+  const std::uint64_t offset,
+  std::function<void()> onChange)
+  : mPath(std::move(path))
+  , mChunk(CHUNK_SIZE)
+  , mOffset(offset)
+  , mOnChange(std::move(onChange))
+  , mInotifyFd(inotify_init1(IN_CLOEXEC | IN_NONBLOCK))
+  , mStopEventFd(eventfd(0, EFD_CLOEXEC))
+{
+  if (!mInotifyFd || !mStopEventFd)
+  {
+    throw std::runtime_error("Failed to initialize inotify");
+  }
+
+  // Rotation replaces the file we're watching, the directory tells us when
+  // the new one shows up. Same for a file which doesn't exist yet.
+  const auto directoryWatch = inotify_add_watch(
+    mInotifyFd.get(),
+    parentDirectory(mPath).c_str(),
+    IN_CREATE | IN_MOVED_TO);
+  if (directoryWatch == -1)
+  {
+    throw std::runtime_error("Failed to watch input file's directory");
+  }
+
+  mFd = UniqueFd{::open(mPath.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (!mFd && errno != ENOENT)
+  {
+    throw std::runtime_error("Failed to open input file");
+  }
+
+  if (mFd)
+  {
+    watch();
+  }
+
+  mThread = std::thread([this]() { watchLoop(); });
+}
+
+
+FileFollower::~FileFollower()
+{
+  const std::uint64_t value = 1;
+  write(mStopEventFd.get(), &value, sizeof(value));
+
+  mThread.join();
+}
+
+
+bool FileFollower::reopenIfReplaced()
+{
+  // The file was gone again when we last tried to watch it.
+  if (mFd && mFileWatch == -1)
+  {
+    watch();
+  }
+
+  // While being rotated, there might not be a file at the path for a bit.
+  // The directory watch wakes us up again once there is. Until then, keep
+  // reading whatever is still written to the old file.
+  struct stat fileInfo;
+  const auto exists = stat(mPath.c_str(), &fileInfo) == 0;
+
+  auto replaced = exists;
+  auto truncated = false;
+  if (mFd)
+  {
+    struct stat openFileInfo;
+    if (fstat(mFd.get(), &openFileInfo) == -1)
+    {
+      return false;
+    }
+
+    replaced = exists &&
+      (fileInfo.st_dev != openFileInfo.st_dev || fileInfo.st_ino != openFileInfo.st_ino);
+    truncated = static_cast<std::uint64_t>(openFileInfo.st_size) < mOffset;
+  }
+
+  if (!replaced && !truncated)
+  {
+    return false;
+  }
+
+  // If the new file is gone again already, keep the old one for now.
+  auto newFd = UniqueFd{::open(mPath.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (!newFd)
+  {
+    return false;
+  }
+
+  mFd = std::move(newFd);
+
+  if (replaced)
+  {
+    if (mFileWatch != -1)
+    {
+      inotify_rm_watch(mInotifyFd.get(), mFileWatch);
+    }
+
+    watch();
+  }
+
+  mOffset = 0;
+  return true;
+}
+
+
+void FileFollower::watch()
+{
+  // Modifications (including truncation) of the file itself. Watching the
+  // path means following whatever file is there when the watch is added.
+  // If there's none right now, this is tried again on the next change in
+  // the directory.
+  mFileWatch = inotify_add_watch(
+    mInotifyFd.get(), mPath.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE);
+}
+
+
+std::size_t FileFollower::readChunk()
+{
+  // A failed read is tried again on the next change.
+  while (mFd)
+  {
+    const auto bytesRead = pread(mFd.get(), mChunk.data(), mChunk.size(), off_t(mOffset));
+    if (bytesRead >= 0)
+    {
+      mOffset += bytesRead;
+      return bytesRead;
+    }
+
+    if (errno != EINTR)
+    {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+
+void FileFollower::watchLoop()
+{
+  for (;;)
+  {
+    struct pollfd pollData[] = {
+      {mInotifyFd.get(), POLLIN, 0},
+      {mStopEventFd.get(), POLLIN, 0}
+    };
+
+    if (poll(pollData, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      break;
+    }
+
+    if (pollData[1].revents)
+    {
+      break;
+    }
+
+    // The UI thread looks at the file itself, so the events only matter as
+    // a wakeup.
+    alignas(inotify_event) char events[4096];
+    while (read(mInotifyFd.get(), events, sizeof(events)) > 0)
+    {
+    }
+
+    if (!mChangePending.exchange(true) && mOnChange)
+    {
+      mOnChange();
+    }
+  }
+}
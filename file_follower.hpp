@@ -0,0 +1,128 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "unique_fd.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/** Picks up text appended to a file, like tail -F.
+  *
+  * A background thread waits for inotify events on the file and its
+  * directory, and invokes the given callback when something happened. The
+  * UI thread then reads only the appended part of the file with pread().
+  * Notifications are coalesced until the next call to checkForChanges().
+  *
+  * When the file is truncated, or replaced by a new file with the same name
+  * (log rotation), it's opened again and reading restarts at the beginning.
+  * A file which doesn't exist yet is picked up once it's created. Errors
+  * while following only mean that nothing new is read for the time being.
+  */
+class FileFollower {
+public:
+  /** Start following the file at the given path. Text before offset is
+    * assumed to be known already. Throws if the file's directory can't be
+    * watched.
+    */
+  FileFollower(
+    std::string path,
+    std::uint64_t offset,
+    std::function<void()> onChange = {});
+  ~FileFollower();
+
+  FileFollower(const FileFollower&) = delete;
+  FileFollower& operator=(const FileFollower&) = delete;
+
+  /** True if the file might have changed since the last call. */
+  bool checkForChanges() { return mChangePending.exchange(false); }
+
+  /** Have the next checkForChanges() return true, when picking up changes
+    * had to be postponed.
+    */
+  void checkAgain() { mChangePending.store(true); }
+
+  /** Open the file again if it was truncated or replaced, or open it once
+    * it exists.
+    *
+    * Returns true in that case. All text read so far is then stale, and
+    * reading continues from the start of the new file.
+    */
+  bool reopenIfReplaced();
+
+  /** The currently open file, -1 while there is none. */
+  int fd() const { return mFd.get(); }
+
+  /** Treat the next size bytes as read, e.g. when they were mapped. */
+  void skip(const std::uint64_t size) { mOffset += size; }
+
+  /** Hand all text appended since the last call to the given function.
+    *
+    * The function is called with (const char* pData, std::size_t size),
+    * possibly more than once. Returns the total number of bytes read.
+    */
+  template <typename Callback>
+  std::size_t consume(Callback&& callback)
+  {
+    std::size_t totalSize = 0;
+
+    // A short read means we've reached the current end of the file.
+    for (;;)
+    {
+      const auto size = readChunk();
+      if (size > 0)
+      {
+        callback(mChunk.data(), size);
+        totalSize += size;
+      }
+
+      if (size < mChunk.size())
+      {
+        break;
+      }
+    }
+
+    return totalSize;
+  }
+
+private:
+  void watch();
+  std::size_t readChunk();
+  void watchLoop();
+
+  std::string mPath;
+  std::vector<char> mChunk;
+  std::uint64_t mOffset;
+  std::atomic<bool> mChangePending{true};
+  std::function<void()> mOnChange;
+  UniqueFd mFd;
+  UniqueFd mInotifyFd;
+  int mFileWatch = -1;
+  UniqueFd mStopEventFd;
+  std::thread mThread;
+};
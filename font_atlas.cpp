@@ -0,0 +1,167 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "font_atlas.hpp"
+
+#include "font_cache.hpp"
+
+#include "imgui_internal.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+
+DynamicFontAtlas::DynamicFontAtlas(
+  ImFontAtlas* pAtlas,
+  const std::string& fontPath,
+  const float sizePixels)
+  : mpAtlas(pAtlas)
+  , mFontPath(fontPath)
+  , mSizePixels(sizePixels)
+{
+  // A font file which can't be stat()-ed can't be loaded either, and we
+  // use the built-in font.
+  struct stat fileInfo;
+  if (stat(fontPath.c_str(), &fileInfo) == 0)
+  {
+    mFontFileVersion =
+      std::to_string(fileInfo.st_size) + " " +
+      std::to_string(fileInfo.st_mtim.tv_sec) + "." +
+      std::to_string(fileInfo.st_mtim.tv_nsec);
+  }
+
+  mGlyphs.AddRanges(mpAtlas->GetGlyphRangesDefault());
+}
+
+
+void DynamicFontAtlas::rebuild()
+{
+  mNeedsRebuild = false;
+
+  // Only the atlas built at startup is cached. Storing the ones rebuilt
+  // while scrolling would mean writing the whole texture to disk in the
+  // middle of frames, and each of them would push an atlas that's useful
+  // for the next launch out of the cache.
+  const auto useCache = mIsInitialBuild && !mFontFileVersion.empty();
+  mIsInitialBuild = false;
+
+  mGlyphRanges.clear();
+  mGlyphs.BuildRanges(&mGlyphRanges);
+
+  const auto key = useCache ? cacheKey() : std::string{};
+  if (useCache && loadCachedFontAtlas(mpAtlas, key))
+  {
+    return;
+  }
+
+  mpAtlas->Clear();
+
+  if (!loadFontData())
+  {
+    ImFontConfig config;
+    config.SizePixels = mSizePixels;
+    mpAtlas->AddFontDefault(&config);
+  }
+  else
+  {
+    // We keep hold of the font data ourselves, so it doesn't need to be
+    // loaded from disk again on each rebuild.
+    ImFontConfig config;
+    config.FontDataOwnedByAtlas = false;
+    mpAtlas->AddFontFromMemoryTTF(
+      mFontData.data(),
+      static_cast<int>(mFontData.size()),
+      mSizePixels,
+      &config,
+      mGlyphRanges.Data);
+  }
+
+  mpAtlas->Build();
+
+  if (useCache && !mFontData.empty())
+  {
+    storeCachedFontAtlas(*mpAtlas, key);
+  }
+}
+
+
+void DynamicFontAtlas::addNonAsciiText(const char* pBegin, const char* pEnd)
+{
+  // Without a TrueType font, there's nothing beyond ASCII to rasterize.
+  if (mFontFileVersion.empty())
+  {
+    return;
+  }
+
+  for (auto p = findNonAscii(pBegin, pEnd); p < pEnd; p = findNonAscii(p, pEnd))
+  {
+    // Stray continuation bytes are consumed without a character.
+    unsigned int codepoint = 0;
+    p += std::max(ImTextCharFromUtf8(&codepoint, p, pEnd), 1);
+
+    // ImWchar can't represent anything beyond the BMP.
+    if (codepoint > 0 && codepoint <= 0xFFFF && !mGlyphs.GetBit(codepoint))
+    {
+      mGlyphs.SetBit(codepoint);
+      mNeedsRebuild = true;
+    }
+  }
+}
+
+
+bool DynamicFontAtlas::loadFontData()
+{
+  if (mFontData.empty() && !mFontFileVersion.empty())
+  {
+    std::ifstream file(mFontPath, std::ios::binary);
+    if (file.is_open())
+    {
+      mFontData.assign(
+        std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>());
+    }
+
+    // Don't bother collecting glyphs we can't rasterize.
+    if (mFontData.empty())
+    {
+      mFontFileVersion.clear();
+    }
+  }
+
+  return !mFontData.empty();
+}
+
+
+std::string DynamicFontAtlas::cacheKey() const
+{
+  auto key = mFontPath + "\n" + mFontFileVersion + "\n" +
+    std::to_string(mSizePixels) + "\n";
+  for (const auto c : mGlyphRanges)
+  {
+    key += std::to_string(c);
+    key += ',';
+  }
+
+  return key;
+}
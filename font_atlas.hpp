@@ -0,0 +1,90 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "utf8.hpp"
+
+#include "imgui.h"
+
+#include <string>
+#include <vector>
+
+
+/** Font atlas which only contains glyphs for characters actually shown.
+  *
+  * Rasterizing a whole CJK glyph range up front is slow and needs a lot of
+  * texture memory. Instead, we start out with ASCII only, and collect
+  * characters from the text as it's displayed. When unknown characters
+  * show up, the atlas is rebuilt with the additional glyphs before the
+  * next frame.
+  *
+  * If the TrueType font can't be loaded, ImGui's built-in font is used
+  * instead, which only covers ASCII.
+  *
+  * The atlas built at startup is kept in an on-disk cache (see
+  * font_cache.hpp). The font file itself is only read once the cache
+  * misses.
+  */
+class DynamicFontAtlas {
+public:
+  DynamicFontAtlas(ImFontAtlas* pAtlas, const std::string& fontPath, float sizePixels);
+
+  DynamicFontAtlas(const DynamicFontAtlas&) = delete;
+  DynamicFontAtlas& operator=(const DynamicFontAtlas&) = delete;
+
+  /** Request glyphs for all characters in the given UTF-8 text.
+    *
+    * Cheap for ASCII text and characters that were seen before.
+    */
+  void addText(const char* pBegin, const char* pEnd)
+  {
+    const auto pNonAscii = findNonAscii(pBegin, pEnd);
+    if (pNonAscii != pEnd)
+    {
+      addNonAsciiText(pNonAscii, pEnd);
+    }
+  }
+
+  bool needsRebuild() const { return mNeedsRebuild; }
+
+  /** Rebuild the atlas with all glyphs requested so far.
+    *
+    * Must not be called while a frame is in progress. The renderer's font
+    * texture needs to be recreated afterwards.
+    */
+  void rebuild();
+
+private:
+  void addNonAsciiText(const char* pBegin, const char* pEnd);
+  bool loadFontData();
+  std::string cacheKey() const;
+
+  ImFontAtlas* mpAtlas;
+  std::string mFontPath;
+  std::string mFontFileVersion;
+  std::vector<char> mFontData;
+  float mSizePixels;
+  ImFontGlyphRangesBuilder mGlyphs;
+  ImVector<ImWchar> mGlyphRanges;
+  bool mNeedsRebuild = true;
+  bool mIsInitialBuild = true;
+};
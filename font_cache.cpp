@@ -0,0 +1,350 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "font_cache.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+
+constexpr char CACHE_MAGIC[8] = {'T', 'V', 'F', 'A', 'T', 'L', 'A', '1'};
+
+// Every distinct set of glyphs results in another cache entry, so keep
+// only the most recently written ones.
+constexpr auto MAX_CACHE_ENTRIES = std::size_t{16};
+
+
+std::string cacheDirectory()
+{
+  if (const auto pXdgCacheHome = std::getenv("XDG_CACHE_HOME");
+    pXdgCacheHome && *pXdgCacheHome)
+  {
+    return std::string{pXdgCacheHome} + "/TvTextViewer";
+  }
+
+  if (const auto pHome = std::getenv("HOME"); pHome && *pHome)
+  {
+    return std::string{pHome} + "/.cache/TvTextViewer";
+  }
+
+  return {};
+}
+
+
+bool createDirectories(const std::string& path)
+{
+  for (auto pos = path.find('/', 1); ; pos = path.find('/', pos + 1))
+  {
+    const auto parent = path.substr(0, pos);
+    if (mkdir(parent.c_str(), 0755) == -1 && errno != EEXIST)
+    {
+      return false;
+    }
+
+    if (pos == std::string::npos)
+    {
+      return true;
+    }
+  }
+}
+
+
+std::string cacheFile(const std::string& key)
+{
+  const auto directory = cacheDirectory();
+  if (directory.empty())
+  {
+    return {};
+  }
+
+  // FNV-1a. Collisions are harmless, the full key is stored in the file
+  // and checked on load.
+  auto hash = std::uint64_t{14695981039346656037ull};
+  for (const auto c : key)
+  {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.atlas", static_cast<unsigned long long>(hash));
+  return directory + '/' + name;
+}
+
+
+// The layout of ImGui's structs is stored as is, which is only valid for
+// the exact same build. Make sure that's part of the key.
+std::string fullKey(const std::string& key)
+{
+  return key +
+    "\nimgui " + std::to_string(IMGUI_VERSION_NUM) +
+    " glyph " + std::to_string(sizeof(ImFontGlyph)) +
+    " lines " + std::to_string(IM_DRAWLIST_TEX_LINES_WIDTH_MAX);
+}
+
+
+template<typename T>
+void writeValue(std::ofstream& file, const T& value)
+{
+  file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+
+template<typename T>
+bool readValue(std::ifstream& file, T& value)
+{
+  return bool(file.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+
+bool hasAtlasExtension(const char* pName)
+{
+  const auto length = std::strlen(pName);
+  return length > 6 && std::strcmp(pName + length - 6, ".atlas") == 0;
+}
+
+
+void pruneCache(const std::string& directory)
+{
+  const auto pDir = opendir(directory.c_str());
+  if (!pDir)
+  {
+    return;
+  }
+
+  std::vector<std::pair<std::time_t, std::string>> entries;
+  while (const auto pEntry = readdir(pDir))
+  {
+    if (!hasAtlasExtension(pEntry->d_name))
+    {
+      continue;
+    }
+
+    auto path = directory + '/' + pEntry->d_name;
+    struct stat fileInfo;
+    if (stat(path.c_str(), &fileInfo) == 0)
+    {
+      entries.emplace_back(fileInfo.st_mtime, std::move(path));
+    }
+  }
+
+  closedir(pDir);
+
+  if (entries.size() <= MAX_CACHE_ENTRIES)
+  {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end());
+  for (auto i = std::size_t{0}; i < entries.size() - MAX_CACHE_ENTRIES; ++i)
+  {
+    unlink(entries[i].second.c_str());
+  }
+}
+
+}
+
+
+bool loadCachedFontAtlas(ImFontAtlas* pAtlas, const std::string& key)
+{
+  const auto path = cacheFile(key);
+  if (path.empty())
+  {
+    return false;
+  }
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+  {
+    return false;
+  }
+
+  const auto expectedKey = fullKey(key);
+
+  char magic[sizeof(CACHE_MAGIC)];
+  auto keySize = std::uint32_t{};
+  if (
+    !readValue(file, magic) ||
+    std::memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+    !readValue(file, keySize) ||
+    keySize != expectedKey.size())
+  {
+    return false;
+  }
+
+  std::string storedKey(keySize, '\0');
+  if (!file.read(storedKey.data(), keySize) || storedKey != expectedKey)
+  {
+    return false;
+  }
+
+  auto texWidth = 0;
+  auto texHeight = 0;
+  auto texUvScale = ImVec2{};
+  auto texUvWhitePixel = ImVec2{};
+  auto fontSize = 0.0f;
+  auto ascent = 0.0f;
+  auto descent = 0.0f;
+  auto fallbackChar = ImWchar{};
+  auto ellipsisChar = ImWchar{};
+  auto glyphCount = std::uint32_t{};
+  ImVec4 texUvLines[IM_DRAWLIST_TEX_LINES_WIDTH_MAX + 1];
+  if (
+    !readValue(file, texWidth) ||
+    !readValue(file, texHeight) ||
+    !readValue(file, texUvScale) ||
+    !readValue(file, texUvWhitePixel) ||
+    !readValue(file, texUvLines) ||
+    !readValue(file, fontSize) ||
+    !readValue(file, ascent) ||
+    !readValue(file, descent) ||
+    !readValue(file, fallbackChar) ||
+    !readValue(file, ellipsisChar) ||
+    !readValue(file, glyphCount) ||
+    texWidth <= 0 ||
+    texHeight <= 0 ||
+    glyphCount == 0)
+  {
+    return false;
+  }
+
+  std::vector<ImFontGlyph> glyphs(glyphCount);
+  const auto pixelCount = std::size_t(texWidth) * std::size_t(texHeight);
+  auto pPixels = static_cast<unsigned char*>(IM_ALLOC(pixelCount));
+  if (
+    !file.read(reinterpret_cast<char*>(glyphs.data()), glyphs.size() * sizeof(ImFontGlyph)) ||
+    !file.read(reinterpret_cast<char*>(pPixels), pixelCount))
+  {
+    IM_FREE(pPixels);
+    return false;
+  }
+
+  // This recreates what ImFontAtlas::Build() leaves behind, minus the
+  // source font data which is not needed for rendering.
+  pAtlas->Clear();
+  pAtlas->TexPixelsAlpha8 = pPixels;
+  pAtlas->TexWidth = texWidth;
+  pAtlas->TexHeight = texHeight;
+  pAtlas->TexUvScale = texUvScale;
+  pAtlas->TexUvWhitePixel = texUvWhitePixel;
+  std::copy(std::begin(texUvLines), std::end(texUvLines), pAtlas->TexUvLines);
+
+  auto pFont = IM_NEW(ImFont);
+  pFont->ContainerAtlas = pAtlas;
+  pFont->FontSize = fontSize;
+  pFont->Ascent = ascent;
+  pFont->Descent = descent;
+  pFont->FallbackChar = fallbackChar;
+  pFont->EllipsisChar = ellipsisChar;
+  pFont->Glyphs.resize(static_cast<int>(glyphCount));
+  std::copy(glyphs.begin(), glyphs.end(), pFont->Glyphs.Data);
+  pFont->BuildLookupTable();
+  pAtlas->Fonts.push_back(pFont);
+
+  return true;
+}
+
+
+void storeCachedFontAtlas(const ImFontAtlas& atlas, const std::string& key)
+{
+  if (atlas.Fonts.Size != 1 || !atlas.TexPixelsAlpha8)
+  {
+    return;
+  }
+
+  const auto path = cacheFile(key);
+  if (path.empty())
+  {
+    return;
+  }
+
+  const auto directory = path.substr(0, path.rfind('/'));
+  if (!createDirectories(directory))
+  {
+    return;
+  }
+
+  // Other instances might be reading the cache at the same time, so write
+  // to a temporary file and rename it into place.
+  const auto tempPath = path + ".tmp" + std::to_string(getpid());
+
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+      return;
+    }
+
+    const auto storedKey = fullKey(key);
+    const auto& font = *atlas.Fonts[0];
+
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    writeValue(file, static_cast<std::uint32_t>(storedKey.size()));
+    file.write(storedKey.data(), storedKey.size());
+    writeValue(file, atlas.TexWidth);
+    writeValue(file, atlas.TexHeight);
+    writeValue(file, atlas.TexUvScale);
+    writeValue(file, atlas.TexUvWhitePixel);
+    writeValue(file, atlas.TexUvLines);
+    writeValue(file, font.FontSize);
+    writeValue(file, font.Ascent);
+    writeValue(file, font.Descent);
+    writeValue(file, font.FallbackChar);
+    writeValue(file, font.EllipsisChar);
+    writeValue(file, static_cast<std::uint32_t>(font.Glyphs.Size));
+    file.write(
+      reinterpret_cast<const char*>(font.Glyphs.Data),
+      font.Glyphs.Size * sizeof(ImFontGlyph));
+    file.write(
+      reinterpret_cast<const char*>(atlas.TexPixelsAlpha8),
+      std::size_t(atlas.TexWidth) * std::size_t(atlas.TexHeight));
+
+    if (!file.flush())
+    {
+      file.close();
+      unlink(tempPath.c_str());
+      return;
+    }
+  }
+
+  if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+  {
+    unlink(tempPath.c_str());
+    return;
+  }
+
+  pruneCache(directory);
+}
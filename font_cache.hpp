@@ -0,0 +1,47 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "imgui.h"
+
+#include <string>
+
+
+/** On-disk cache of rasterized font atlases.
+  *
+  * Rasterizing a TrueType font is by far the most expensive part of
+  * starting up, and the viewer tends to be launched many times in a row with
+  * the same font. A finished atlas is stored with its texture and glyph
+  * metrics under $XDG_CACHE_HOME/TvTextViewer, so that later launches only
+  * need to upload the texture.
+  *
+  * The key must identify everything that went into building the atlas.
+  * Caching is best effort, any failure just results in a miss.
+  */
+
+/** Replace the contents of the atlas with the cached version, if there is
+  * one. Returns false on a cache miss, leaving the atlas empty.
+  */
+bool loadCachedFontAtlas(ImFontAtlas* pAtlas, const std::string& key);
+
+/** Store a built atlas containing a single font. */
+void storeCachedFontAtlas(const ImFontAtlas& atlas, const std::string& key);
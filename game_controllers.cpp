@@ -0,0 +1,170 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+#include "game_controllers.hpp"
+
+#include <cstdlib>
+
+
+GameControllers::~GameControllers()
+{
+  for (const auto& [id, controller] : mControllers)
+  {
+    SDL_GameControllerClose(controller.mpController);
+  }
+}
+
+
+void GameControllers::handleEvent(const SDL_Event& event)
+{
+  switch (event.type)
+  {
+    case SDL_CONTROLLERDEVICEADDED:
+      addController(event.cdevice.which);
+      break;
+
+    case SDL_CONTROLLERDEVICEREMOVED:
+      removeController(event.cdevice.which);
+      break;
+
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONUP:
+      if (
+        const auto iController = mControllers.find(event.cbutton.which);
+        iController != mControllers.end() &&
+        event.cbutton.button < SDL_CONTROLLER_BUTTON_MAX)
+      {
+        const auto mask = std::uint32_t{1} << event.cbutton.button;
+        auto& buttonsHeld = iController->second.mButtonsHeld;
+        buttonsHeld = event.type == SDL_CONTROLLERBUTTONDOWN
+          ? buttonsHeld | mask
+          : buttonsHeld & ~mask;
+        updateButtons();
+      }
+      break;
+
+    case SDL_CONTROLLERAXISMOTION:
+      if (
+        const auto iController = mControllers.find(event.caxis.which);
+        iController != mControllers.end() &&
+        event.caxis.axis < SDL_CONTROLLER_AXIS_MAX)
+      {
+        iController->second.mAxes[event.caxis.axis] = event.caxis.value;
+        updateAxis(SDL_GameControllerAxis(event.caxis.axis));
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+void GameControllers::addController(const int deviceIndex)
+{
+  const auto pController = SDL_GameControllerOpen(deviceIndex);
+  if (!pController)
+  {
+    return;
+  }
+
+  // Opening a controller again only adds a reference to it.
+  const auto id = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(pController));
+  if (mControllers.count(id))
+  {
+    SDL_GameControllerClose(pController);
+    return;
+  }
+
+  // Buttons might be held already, without any events for them.
+  auto controller = Controller{pController};
+  for (auto button = 0; button < SDL_CONTROLLER_BUTTON_MAX; ++button)
+  {
+    if (SDL_GameControllerGetButton(pController, SDL_GameControllerButton(button)))
+    {
+      controller.mButtonsHeld |= std::uint32_t{1} << button;
+    }
+  }
+
+  for (auto axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; ++axis)
+  {
+    controller.mAxes[axis] =
+      SDL_GameControllerGetAxis(pController, SDL_GameControllerAxis(axis));
+  }
+
+  mControllers.emplace(id, controller);
+
+  updateButtons();
+  for (auto axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; ++axis)
+  {
+    updateAxis(SDL_GameControllerAxis(axis));
+  }
+}
+
+
+void GameControllers::removeController(const SDL_JoystickID id)
+{
+  const auto iController = mControllers.find(id);
+  if (iController == mControllers.end())
+  {
+    return;
+  }
+
+  SDL_GameControllerClose(iController->second.mpController);
+  mControllers.erase(iController);
+
+  updateButtons();
+  for (auto axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; ++axis)
+  {
+    updateAxis(SDL_GameControllerAxis(axis));
+  }
+}
+
+
+void GameControllers::updateButtons()
+{
+  mButtonsHeld = 0;
+  for (const auto& [id, controller] : mControllers)
+  {
+    mButtonsHeld |= controller.mButtonsHeld;
+  }
+}
+
+
+void GameControllers::updateAxis(const SDL_GameControllerAxis axis)
+{
+  auto value = Sint16{0};
+  for (const auto& [id, controller] : mControllers)
+  {
+    if (std::abs(controller.mAxes[axis]) > std::abs(value))
+    {
+      value = controller.mAxes[axis];
+    }
+  }
+
+  mAxes[axis] = value;
+
+  const auto mask = std::uint32_t{1} << axis;
+  mDeflectedAxes = std::abs(value) > DEAD_ZONE
+    ? mDeflectedAxes | mask
+    : mDeflectedAxes & ~mask;
+}
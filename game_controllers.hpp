@@ -0,0 +1,89 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+#pragma once
+
+#include <SDL.h>
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+
+
+/** State of all connected game controllers, kept up to date from events.
+  *
+  * Controllers are opened and closed individually as they are plugged in
+  * and removed, keyed by their joystick instance ID. Button and axis values
+  * are taken from controller events, and combined over all controllers as
+  * they change, so that looking them up each frame doesn't need to query
+  * any devices.
+  *
+  * SDL sends an added event for each controller already connected at
+  * startup, so there's no need to enumerate them.
+  */
+class GameControllers {
+public:
+  /** Axis values closer to the center than this count as released.
+    * SDL_gamecontroller.h suggests using this value.
+    */
+  static constexpr auto DEAD_ZONE = 8000;
+
+  GameControllers() = default;
+  ~GameControllers();
+
+  GameControllers(const GameControllers&) = delete;
+  GameControllers& operator=(const GameControllers&) = delete;
+
+  /** Update the state from controller events. Other events are ignored. */
+  void handleEvent(const SDL_Event& event);
+
+  /** True if the button is held on any controller. */
+  bool isButtonHeld(const SDL_GameControllerButton button) const
+  {
+    return (mButtonsHeld & (std::uint32_t{1} << button)) != 0;
+  }
+
+  /** The axis value furthest from the center over all controllers. */
+  Sint16 axis(const SDL_GameControllerAxis axis) const { return mAxes[axis]; }
+
+  /** True if any button is held, or any axis is outside the dead zone. */
+  bool isInputHeld() const { return mButtonsHeld != 0 || mDeflectedAxes != 0; }
+
+private:
+  struct Controller {
+    SDL_GameController* mpController;
+    std::uint32_t mButtonsHeld = 0;
+    std::array<Sint16, SDL_CONTROLLER_AXIS_MAX> mAxes{};
+  };
+
+  void addController(int deviceIndex);
+  void removeController(SDL_JoystickID id);
+  void updateButtons();
+  void updateAxis(SDL_GameControllerAxis axis);
+
+  std::unordered_map<SDL_JoystickID, Controller> mControllers;
+
+  // Combined over all controllers
+  std::uint32_t mButtonsHeld = 0;
+  std::array<Sint16, SDL_CONTROLLER_AXIS_MAX> mAxes{};
+  std::uint32_t mDeflectedAxes = 0;
+};
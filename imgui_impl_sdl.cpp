@@ -47,6 +47,8 @@
 #include "imgui.h"
 #include "imgui_impl_sdl.h"
 
+#include "game_controllers.hpp"
+
 #include <algorithm>
 
 // SDL
@@ -304,7 +306,9 @@ static void ImGui_ImplSDL2_UpdateMouseCursor()
     }
 }
 
-static void ImGui_ImplSDL2_UpdateGamepads(const std::vector<SDL_GameController*>& game_controllers)
+// TvTextViewer: Controller state comes from a cache that's kept up to date
+// by controller events, instead of querying every controller each frame.
+static void ImGui_ImplSDL2_UpdateGamepads(const GameControllers& game_controllers)
 {
     ImGuiIO& io = ImGui::GetIO();
     memset(io.NavInputs, 0, sizeof(io.NavInputs));
@@ -312,55 +316,46 @@ static void ImGui_ImplSDL2_UpdateGamepads(const std::vector<SDL_GameController*>
         return;
 
     // Update gamepad inputs
-    //
-    for (const auto game_controller : game_controllers)
+    auto mapButton = [&](const auto nav_no, const auto button_no)
     {
-      auto mapButton = [&](const auto nav_no, const auto button_no)
+      if (game_controllers.isButtonHeld(button_no))
       {
-        const auto is_pressed =
-          SDL_GameControllerGetButton(game_controller, button_no) != 0;
-        const auto value = (is_pressed) ? 1.0f : 0.0f;
-
-        io.NavInputs[nav_no] = std::clamp(
-          io.NavInputs[nav_no] + value, 0.0f, 1.0f);
-      };
+        io.NavInputs[nav_no] = 1.0f;
+      }
+    };
 
-      auto mapAnalog = [&](const auto nav_no, const auto axis_no, const auto v0, const auto v1)
+    auto mapAnalog = [&](const auto nav_no, const auto axis_no, const auto v0, const auto v1)
+    {
+      float vn = (float)(game_controllers.axis(axis_no) - v0) / (float)(v1 - v0);
+      if (vn > 1.0f) vn = 1.0f;
+      if (vn > 0.0f && io.NavInputs[nav_no] < vn)
       {
-        float vn =
-          (float)(SDL_GameControllerGetAxis(game_controller, axis_no) - v0) /
-          (float)(v1 - v0);
-
-        if (vn > 1.0f) vn = 1.0f;
-        if (vn > 0.0f && io.NavInputs[nav_no] < vn)
-        {
-          io.NavInputs[nav_no] += vn;
-        }
-      };
-
-      const int thumb_dead_zone = 8000;           // SDL_gamecontroller.h suggests using this value.
-      mapButton(ImGuiNavInput_Activate,      SDL_CONTROLLER_BUTTON_A);               // Cross / A
-      mapButton(ImGuiNavInput_Activate,      SDL_CONTROLLER_BUTTON_START);           // Start
-      mapButton(ImGuiNavInput_Cancel,        SDL_CONTROLLER_BUTTON_B);               // Circle / B
-      // TvTextViewer: Disable the window switch interaction as it only confuses users.
-      //mapButton(ImGuiNavInput_Menu,          SDL_CONTROLLER_BUTTON_X);               // Square / X
-      mapButton(ImGuiNavInput_Input,         SDL_CONTROLLER_BUTTON_Y);               // Triangle / Y
-      mapButton(ImGuiNavInput_DpadLeft,      SDL_CONTROLLER_BUTTON_DPAD_LEFT);       // D-Pad Left
-      mapButton(ImGuiNavInput_DpadRight,     SDL_CONTROLLER_BUTTON_DPAD_RIGHT);      // D-Pad Right
-      mapButton(ImGuiNavInput_DpadUp,        SDL_CONTROLLER_BUTTON_DPAD_UP);         // D-Pad Up
-      mapButton(ImGuiNavInput_DpadDown,      SDL_CONTROLLER_BUTTON_DPAD_DOWN);       // D-Pad Down
-      mapButton(ImGuiNavInput_FocusPrev,     SDL_CONTROLLER_BUTTON_LEFTSHOULDER);    // L1 / LB
-      mapButton(ImGuiNavInput_FocusNext,     SDL_CONTROLLER_BUTTON_RIGHTSHOULDER);   // R1 / RB
-      mapButton(ImGuiNavInput_TweakSlow,     SDL_CONTROLLER_BUTTON_LEFTSHOULDER);    // L1 / LB
-      mapButton(ImGuiNavInput_TweakFast,     SDL_CONTROLLER_BUTTON_RIGHTSHOULDER);   // R1 / RB
-      mapAnalog(ImGuiNavInput_LStickLeft,    SDL_CONTROLLER_AXIS_LEFTX, -thumb_dead_zone, -32768);
-      mapAnalog(ImGuiNavInput_LStickRight,   SDL_CONTROLLER_AXIS_LEFTX, +thumb_dead_zone, +32767);
-      mapAnalog(ImGuiNavInput_LStickUp,      SDL_CONTROLLER_AXIS_LEFTY, -thumb_dead_zone, -32767);
-      mapAnalog(ImGuiNavInput_LStickDown,    SDL_CONTROLLER_AXIS_LEFTY, +thumb_dead_zone, +32767);
-    }
+        io.NavInputs[nav_no] = vn;
+      }
+    };
+
+    const int thumb_dead_zone = GameControllers::DEAD_ZONE;
+    mapButton(ImGuiNavInput_Activate,      SDL_CONTROLLER_BUTTON_A);               // Cross / A
+    mapButton(ImGuiNavInput_Activate,      SDL_CONTROLLER_BUTTON_START);           // Start
+    mapButton(ImGuiNavInput_Cancel,        SDL_CONTROLLER_BUTTON_B);               // Circle / B
+    // TvTextViewer: Disable the window switch interaction as it only confuses users.
+    //mapButton(ImGuiNavInput_Menu,          SDL_CONTROLLER_BUTTON_X);               // Square / X
+    mapButton(ImGuiNavInput_Input,         SDL_CONTROLLER_BUTTON_Y);               // Triangle / Y
+    mapButton(ImGuiNavInput_DpadLeft,      SDL_CONTROLLER_BUTTON_DPAD_LEFT);       // D-Pad Left
+    mapButton(ImGuiNavInput_DpadRight,     SDL_CONTROLLER_BUTTON_DPAD_RIGHT);      // D-Pad Right
+    mapButton(ImGuiNavInput_DpadUp,        SDL_CONTROLLER_BUTTON_DPAD_UP);         // D-Pad Up
+    mapButton(ImGuiNavInput_DpadDown,      SDL_CONTROLLER_BUTTON_DPAD_DOWN);       // D-Pad Down
+    mapButton(ImGuiNavInput_FocusPrev,     SDL_CONTROLLER_BUTTON_LEFTSHOULDER);    // L1 / LB
+    mapButton(ImGuiNavInput_FocusNext,     SDL_CONTROLLER_BUTTON_RIGHTSHOULDER);   // R1 / RB
+    mapButton(ImGuiNavInput_TweakSlow,     SDL_CONTROLLER_BUTTON_LEFTSHOULDER);    // L1 / LB
+    mapButton(ImGuiNavInput_TweakFast,     SDL_CONTROLLER_BUTTON_RIGHTSHOULDER);   // R1 / RB
+    mapAnalog(ImGuiNavInput_LStickLeft,    SDL_CONTROLLER_AXIS_LEFTX, -thumb_dead_zone, -32768);
+    mapAnalog(ImGuiNavInput_LStickRight,   SDL_CONTROLLER_AXIS_LEFTX, +thumb_dead_zone, +32767);
+    mapAnalog(ImGuiNavInput_LStickUp,      SDL_CONTROLLER_AXIS_LEFTY, -thumb_dead_zone, -32767);
+    mapAnalog(ImGuiNavInput_LStickDown,    SDL_CONTROLLER_AXIS_LEFTY, +thumb_dead_zone, +32767);
 }
 
-void ImGui_ImplSDL2_NewFrame(SDL_Window* window, const std::vector<SDL_GameController*>& game_controllers)
+void ImGui_ImplSDL2_NewFrame(SDL_Window* window, const GameControllers& game_controllers)
 {
     ImGuiIO& io = ImGui::GetIO();
     IM_ASSERT(io.Fonts->IsBuilt() && "Font atlas not built! It is generally built by the renderer backend. Missing call to renderer _NewFrame() function? e.g. ImGui_ImplOpenGL3_NewFrame().");
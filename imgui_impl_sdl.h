@@ -17,11 +17,8 @@
 #pragma once
 #include "imgui.h"      // IMGUI_IMPL_API
 
-#include <SDL_gamecontroller.h>
-
-#include <vector>
-
 struct SDL_Window;
+class GameControllers;
 typedef union SDL_Event SDL_Event;
 
 IMGUI_IMPL_API bool     ImGui_ImplSDL2_InitForOpenGL(SDL_Window* window, void* sdl_gl_context);
@@ -29,5 +26,5 @@ IMGUI_IMPL_API bool     ImGui_ImplSDL2_InitForVulkan(SDL_Window* window);
 IMGUI_IMPL_API bool     ImGui_ImplSDL2_InitForD3D(SDL_Window* window);
 IMGUI_IMPL_API bool     ImGui_ImplSDL2_InitForMetal(SDL_Window* window);
 IMGUI_IMPL_API void     ImGui_ImplSDL2_Shutdown();
-IMGUI_IMPL_API void     ImGui_ImplSDL2_NewFrame(SDL_Window* window, const std::vector<SDL_GameController*>& game_controllers);
+IMGUI_IMPL_API void     ImGui_ImplSDL2_NewFrame(SDL_Window* window, const GameControllers& game_controllers);
 IMGUI_IMPL_API bool     ImGui_ImplSDL2_ProcessEvent(const SDL_Event* event);
@@ -0,0 +1,252 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "line_index.hpp"
+
+#include "newline_scan.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+
+namespace
+{
+
+// Amount of text to scan at once when extending the index
+constexpr auto CHUNK_SIZE = std::uint64_t{1024 * 1024};
+
+}
+
+
+void LineIndex::makeSparse(
+  const std::size_t interval,
+  const std::size_t maxCachedBlocks)
+{
+  mInterval = std::max<std::size_t>(interval, 1);
+  mMaxCachedBlocks = std::max<std::size_t>(maxCachedBlocks, 1);
+}
+
+
+void LineIndex::extend(const TextBuffer& text)
+{
+  extend(text, text.endOffset());
+}
+
+
+void LineIndex::extend(const TextBuffer& text, const std::uint64_t endOffset)
+{
+  // Text which was discarded before we got to see it can't be indexed.
+  discardBefore(text.startOffset());
+  mpText = &text;
+
+  // In chunks, so that a mapped file only needs to be mapped a part at a
+  // time.
+  const auto newSize = std::min(endOffset, text.endOffset());
+  while (mIndexedSize < newSize)
+  {
+    const auto chunkEnd = std::min(newSize, mIndexedSize + CHUNK_SIZE);
+    const auto range = text.range(mIndexedSize, chunkEnd);
+    const auto pBegin = range.data();
+    const auto beginOffset = mIndexedSize;
+    forEachNewline(
+      pBegin,
+      pBegin + range.size(),
+      [&](const char* pNewline) {
+        addLineStart(beginOffset + (pNewline + 1 - pBegin));
+      });
+
+    mIndexedSize = chunkEnd;
+  }
+}
+
+
+void LineIndex::addScannedLines(
+  const std::vector<std::uint64_t>& lineStarts,
+  const std::uint64_t scannedOffset)
+{
+  if (mInterval == 1)
+  {
+    mLineStarts.insert(mLineStarts.end(), lineStarts.begin(), lineStarts.end());
+  }
+  else
+  {
+    for (const auto offset : lineStarts)
+    {
+      addLineStart(offset);
+    }
+  }
+
+  mIndexedSize = std::max(mIndexedSize, scannedOffset);
+}
+
+
+std::size_t LineIndex::discardBefore(const std::uint64_t offset)
+{
+  std::size_t linesDiscarded = 0;
+  while (mLineStarts.size() > 1 && mLineStarts[1] <= offset)
+  {
+    mLineStarts.pop_front();
+    ++linesDiscarded;
+  }
+
+  if (mLineStarts.front() < offset)
+  {
+    mLineStarts.front() = offset;
+  }
+
+  mIndexedSize = std::max(mIndexedSize, offset);
+  return linesDiscarded;
+}
+
+
+void LineIndex::clear()
+{
+  mLineStarts.assign(1, 0);
+  mIndexedSize = 0;
+  mTailStarts.clear();
+  mCachedBlocks.clear();
+  mCachedBlocksByIndex.clear();
+}
+
+
+std::size_t LineIndex::lineCount() const
+{
+  // The last entry is the start of the line following the last newline.
+  // It only counts once it has some content.
+  return lastLineStart() == mIndexedSize
+    ? lineStartCount() - 1
+    : lineStartCount();
+}
+
+
+std::uint64_t LineIndex::lineStart(const std::size_t line) const
+{
+  if (mInterval == 1)
+  {
+    return mLineStarts[line];
+  }
+
+  const auto blockIndex = line / mInterval;
+  const auto indexInBlock = line % mInterval;
+  if (indexInBlock == 0)
+  {
+    return mLineStarts[blockIndex];
+  }
+
+  return blockIndex + 1 == mLineStarts.size()
+    ? mTailStarts[indexInBlock - 1]
+    : block(blockIndex)[indexInBlock];
+}
+
+
+std::uint64_t LineIndex::lineEnd(const std::size_t line) const
+{
+  return line + 1 < lineStartCount()
+    ? lineStart(line + 1) - 1
+    : mIndexedSize;
+}
+
+
+std::size_t LineIndex::lineForOffset(const std::uint64_t offset) const
+{
+  const auto iNext = std::upper_bound(mLineStarts.begin(), mLineStarts.end(), offset);
+  auto line = std::size_t(std::max<std::ptrdiff_t>(
+    std::distance(mLineStarts.begin(), iNext) - 1, 0));
+
+  // Find the line within its block
+  if (mInterval > 1)
+  {
+    const auto blockIndex = line;
+    const auto& lineStarts = blockIndex + 1 == mLineStarts.size()
+      ? mTailStarts
+      : block(blockIndex);
+    const auto iFirst = blockIndex + 1 == mLineStarts.size()
+      ? lineStarts.begin()
+      : std::next(lineStarts.begin());
+    line = blockIndex * mInterval +
+      std::distance(iFirst, std::upper_bound(iFirst, lineStarts.end(), offset));
+  }
+
+  return std::min(line, lineCount() - 1);
+}
+
+
+void LineIndex::addLineStart(const std::uint64_t offset)
+{
+  if (mInterval == 1 || mTailStarts.size() + 1 == mInterval)
+  {
+    mLineStarts.push_back(offset);
+    mTailStarts.clear();
+  }
+  else
+  {
+    mTailStarts.push_back(offset);
+  }
+}
+
+
+std::size_t LineIndex::lineStartCount() const
+{
+  return (mLineStarts.size() - 1) * mInterval + 1 + mTailStarts.size();
+}
+
+
+std::uint64_t LineIndex::lastLineStart() const
+{
+  return mTailStarts.empty() ? mLineStarts.back() : mTailStarts.back();
+}
+
+
+const std::vector<std::uint64_t>& LineIndex::block(const std::size_t index) const
+{
+  const auto iCached = mCachedBlocksByIndex.find(index);
+  if (iCached != mCachedBlocksByIndex.end())
+  {
+    mCachedBlocks.splice(mCachedBlocks.begin(), mCachedBlocks, iCached->second);
+    return iCached->second->second;
+  }
+
+  // Reuse the least recently used block's memory, if the cache is full.
+  std::vector<std::uint64_t> lineStarts;
+  if (mCachedBlocks.size() >= mMaxCachedBlocks)
+  {
+    mCachedBlocksByIndex.erase(mCachedBlocks.back().first);
+    lineStarts = std::move(mCachedBlocks.back().second);
+    mCachedBlocks.pop_back();
+  }
+
+  // All but the last block are complete, so the block ends with the
+  // newline right before the next block's first line.
+  const auto blockStart = mLineStarts[index];
+  const auto range = mpText->range(blockStart, mLineStarts[index + 1] - 1);
+  const auto pBegin = range.data();
+  lineStarts.assign(1, blockStart);
+  forEachNewline(
+    pBegin,
+    pBegin + range.size(),
+    [&](const char* pNewline) {
+      lineStarts.push_back(blockStart + (pNewline + 1 - pBegin));
+    });
+
+  mCachedBlocks.emplace_front(index, std::move(lineStarts));
+  mCachedBlocksByIndex[index] = mCachedBlocks.begin();
+  return mCachedBlocks.front().second;
+}
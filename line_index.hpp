@@ -0,0 +1,122 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "text_buffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+
+/** Start offsets of all lines in a text buffer.
+  *
+  * Lines are addressed by offsets into a single buffer instead of being
+  * copied out, which costs 8 bytes per line. The index can be extended
+  * incrementally as text is appended to the buffer. A last line without
+  * a terminating newline is included, an empty one after the final
+  * newline is not (same as std::getline).
+  *
+  * When the buffer discards old text, the lines it contained can be
+  * dropped from the front of the index in constant time per line.
+  *
+  * For files larger than memory, the index can be made sparse: only the
+  * start of every Nth line is kept, and the lines in between are found
+  * again by scanning the text when needed. The most recently used of these
+  * blocks of lines are cached.
+  */
+class LineIndex {
+public:
+  /** Only keep every interval-th line start, and cache the lines of at
+    * most maxCachedBlocks blocks. Must be called while the index is still
+    * empty. Sparse indexes can't discard lines.
+    */
+  void makeSparse(std::size_t interval, std::size_t maxCachedBlocks);
+
+  /** Extend the index to cover all of the given text.
+    *
+    * The part that was already indexed must be unchanged, apart from text
+    * discarded at the front.
+    */
+  void extend(const TextBuffer& text);
+
+  /** Same as above, but only index the text up to the given offset. */
+  void extend(const TextBuffer& text, std::uint64_t endOffset);
+
+  /** Add lines found by scanning the text elsewhere, e.g. on a background
+    * thread. lineStarts holds the offsets following each newline found
+    * between the indexed size and scannedOffset.
+    */
+  void addScannedLines(
+    const std::vector<std::uint64_t>& lineStarts,
+    std::uint64_t scannedOffset);
+
+  /** Drop lines which end before the given offset.
+    *
+    * A line which is only partially before the offset now starts there
+    * instead. Returns the number of lines dropped, by which the index of
+    * all remaining lines is reduced.
+    */
+  std::size_t discardBefore(std::uint64_t offset);
+
+  void clear();
+
+  std::size_t lineCount() const;
+
+  /** Offset of the first character in the given line */
+  std::uint64_t lineStart(std::size_t line) const;
+
+  /** Offset one past the last character in the given line, excluding the
+    * newline
+    */
+  std::uint64_t lineEnd(std::size_t line) const;
+
+  /** Index of the line containing the given offset. There must be at
+    * least one line.
+    */
+  std::size_t lineForOffset(std::uint64_t offset) const;
+
+  std::uint64_t indexedSize() const { return mIndexedSize; }
+
+private:
+  void addLineStart(std::uint64_t offset);
+  std::size_t lineStartCount() const;
+  std::uint64_t lastLineStart() const;
+  const std::vector<std::uint64_t>& block(std::size_t index) const;
+
+  // Start of each line, or only of every mInterval-th line when sparse.
+  std::deque<std::uint64_t> mLineStarts{0};
+  std::uint64_t mIndexedSize = 0;
+
+  // Sparse only: starts of lines in the last block after its first one,
+  // and the most recently used blocks, with the most recent one in front.
+  std::size_t mInterval = 1;
+  std::vector<std::uint64_t> mTailStarts;
+  const TextBuffer* mpText = nullptr;
+  std::size_t mMaxCachedBlocks = 0;
+  using CachedBlock = std::pair<std::size_t, std::vector<std::uint64_t>>;
+  mutable std::list<CachedBlock> mCachedBlocks;
+  mutable std::unordered_map<std::size_t, std::list<CachedBlock>::iterator> mCachedBlocksByIndex;
+};
@@ -0,0 +1,151 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "line_indexer.hpp"
+
+#include "newline_scan.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+
+namespace
+{
+
+// Amount of text to scan before handing the lines found to the UI thread
+constexpr auto CHUNK_SIZE = std::uint64_t{1024 * 1024};
+
+}
+
+
+LineIndexer::LineIndexer(
+  const TextBuffer& text,
+  const std::uint64_t beginOffset,
+  std::function<void()> onProgress)
+  : mText(text)
+  , mBeginOffset(beginOffset)
+  , mEndOffset(text.endOffset())
+  , mOnProgress(std::move(onProgress))
+  , mScannedOffset(beginOffset)
+  , mTakenOffset(beginOffset)
+{
+  mThread = std::thread([this]() { indexLoop(); });
+}
+
+
+LineIndexer::~LineIndexer()
+{
+  mStop.store(true);
+  mThread.join();
+}
+
+
+bool LineIndexer::takeLines(LineIndex& lineIndex)
+{
+  mNotificationPending.store(false);
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mScannedOffset == mTakenOffset)
+  {
+    return false;
+  }
+
+  lineIndex.addScannedLines(mNewLineStarts, mScannedOffset);
+  mNewLineStarts.clear();
+  mTakenOffset = mScannedOffset;
+  return true;
+}
+
+
+bool LineIndexer::isFinished() const
+{
+  if (mTakenOffset == mEndOffset)
+  {
+    return true;
+  }
+
+  // Lines found before failing still need to be taken.
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mFailed.load() && mTakenOffset == mScannedOffset;
+}
+
+
+bool LineIndexer::hasFailed() const
+{
+  return mFailed.load();
+}
+
+
+void LineIndexer::indexLoop()
+{
+  try
+  {
+    scanText();
+  }
+  catch (const std::exception&)
+  {
+    mFailed.store(true);
+  }
+
+  // Let the UI thread know, so it doesn't wait for more lines.
+  if (mFailed.load() && mOnProgress && !mNotificationPending.exchange(true))
+  {
+    mOnProgress();
+  }
+}
+
+
+void LineIndexer::scanText()
+{
+  std::vector<std::uint64_t> lineStarts;
+
+  for (auto offset = mBeginOffset; offset < mEndOffset && !mStop.load(); )
+  {
+    // For a mapped file, this is where the text is actually read from disk.
+    const auto chunkEnd = std::min(mEndOffset, offset + CHUNK_SIZE);
+    const auto range = mText.range(offset, chunkEnd);
+    const auto pBegin = range.data();
+    lineStarts.clear();
+    forEachNewline(
+      pBegin,
+      pBegin + range.size(),
+      [&](const char* pNewline) {
+        lineStarts.push_back(offset + (pNewline + 1 - pBegin));
+      });
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mNewLineStarts.insert(mNewLineStarts.end(), lineStarts.begin(), lineStarts.end());
+      mScannedOffset = chunkEnd;
+    }
+
+    // Only the part that's on screen needs to stay in memory, which is
+    // read in again when scrolling there.
+    mText.releasePages(offset, chunkEnd);
+    offset = chunkEnd;
+
+    if (mOnProgress && !mNotificationPending.exchange(true))
+    {
+      mOnProgress();
+    }
+  }
+}
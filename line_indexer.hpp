@@ -0,0 +1,99 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "line_index.hpp"
+#include "text_buffer.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/** Builds the line index of a large text on a background thread.
+  *
+  * The text is scanned in chunks, and the lines found are handed to the UI
+  * thread as they come in. So the first screen can be shown right away,
+  * with the rest of the lines (and the scrollbar's extent) growing while
+  * the remaining text is read from disk. The memory of mapped text is
+  * released again after scanning, so that indexing a file larger than
+  * memory doesn't push everything else out.
+  *
+  * The text buffer must not be modified until indexing has finished or the
+  * indexer is destroyed. The given callback is invoked from the indexing
+  * thread when there's progress, coalesced until the next takeLines().
+  */
+class LineIndexer {
+public:
+  /** Index the text from the given offset to its end. */
+  LineIndexer(
+    const TextBuffer& text,
+    std::uint64_t beginOffset,
+    std::function<void()> onProgress);
+  ~LineIndexer();
+
+  LineIndexer(const LineIndexer&) = delete;
+  LineIndexer& operator=(const LineIndexer&) = delete;
+
+  /** Add the lines found since the last call to the given index, which
+    * must have been indexed up to the begin offset given on construction.
+    *
+    * Returns true if anything was added.
+    */
+  bool takeLines(LineIndex& lineIndex);
+
+  /** True once all lines were handed over by takeLines(), or the text
+    * couldn't be read any further.
+    */
+  bool isFinished() const;
+
+  /** True if reading the text failed, e.g. because a part of a mapped
+    * file couldn't be mapped. Only the lines before that are indexed.
+    */
+  bool hasFailed() const;
+
+  /** Offset up to which lines have been handed over */
+  std::uint64_t indexedOffset() const { return mTakenOffset; }
+
+private:
+  void indexLoop();
+  void scanText();
+
+  const TextBuffer& mText;
+  std::uint64_t mBeginOffset;
+  std::uint64_t mEndOffset;
+  std::function<void()> mOnProgress;
+
+  // Guarded by mMutex
+  mutable std::mutex mMutex;
+  std::vector<std::uint64_t> mNewLineStarts;
+  std::uint64_t mScannedOffset;
+
+  std::uint64_t mTakenOffset;
+  std::atomic<bool> mStop{false};
+  std::atomic<bool> mFailed{false};
+  std::atomic<bool> mNotificationPending{false};
+  std::thread mThread;
+};
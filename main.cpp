@@ -19,6 +19,11 @@
   * SOFTWARE.
   */
 
+#include "file_follower.hpp"
+#include "font_atlas.hpp"
+#include "game_controllers.hpp"
+#include "perf_stats.hpp"
+#include "text_decoder.hpp"
 #include "view.hpp"
 
 #include "imgui.h"
@@ -30,15 +35,77 @@
 #include <GLES2/gl2.h>
 #include <SDL.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
-#include <iostream>
 #include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 
 namespace
 {
 
+constexpr auto FONT_PATH = "/storage/.config/retroarch/regular.ttf";
+constexpr auto DEFAULT_FONT_SIZE = 50;
+
+constexpr auto SETTLE_FRAMES = 3;
+
+// Half of the cache memory is for mapped text, half for line positions.
+constexpr auto DEFAULT_CACHE_MB = 16;
+
+// With less memory available than this, the caches of documents in other
+// tabs are freed when switching tabs.
+constexpr auto LOW_MEMORY_SIZE = std::uint64_t{64 * 1024 * 1024};
+
+// Milliseconds between checks for new script output while idle
+constexpr auto SCRIPT_POLL_INTERVAL = 16;
+
+// How far a trigger needs to be pulled to count as pressed
+constexpr auto TRIGGER_THRESHOLD = 16384;
+
+// Seconds it takes to scrub through the whole text with the right stick
+// fully deflected, however long the text is
+constexpr auto SCRUB_DURATION = 4.0f;
+
+
+std::vector<std::string> stringsArg(
+  const cxxopts::ParseResult& args,
+  const std::string& name)
+{
+  return args.count(name)
+    ? args[name].as<std::vector<std::string>>()
+    : std::vector<std::string>{};
+}
+
+
+bool readsStdin(const cxxopts::ParseResult& args)
+{
+  const auto inputFiles = stringsArg(args, "input_file");
+  return
+    args.count("stdin") ||
+    std::find(inputFiles.begin(), inputFiles.end(), "-") != inputFiles.end();
+}
+
+
+std::size_t inputCount(const cxxopts::ParseResult& args)
+{
+  return
+    args.count("stdin") +
+    args.count("message") +
+    stringsArg(args, "input_file").size() +
+    stringsArg(args, "script_file").size();
+}
+
+
 std::optional<cxxopts::ParseResult> parseArgs(int argc, char** argv)
 {
   try
@@ -46,17 +113,30 @@ std::optional<cxxopts::ParseResult> parseArgs(int argc, char** argv)
     cxxopts::Options options(argv[0], "TvTextViewer - a full-screen text viewer");
 
     options
-      .positional_help("[input file]")
+      .positional_help("[input files...]")
       .show_positional_help()
       .add_options()
-        ("input_file", "text file to view", cxxopts::value<std::string>())
-        ("s,script_file", "script outpout to view", cxxopts::value<std::string>())
+        ("input_file", "text files to view, each in its own tab, - for standard input", cxxopts::value<std::vector<std::string>>())
+        ("stdin", "view text streamed from standard input")
+        ("s,script_file", "script outpout to view, can be given more than once", cxxopts::value<std::vector<std::string>>())
+        ("kill_on_exit", "terminate the script when closing the viewer")
+        ("script_exit_code", "exit with the script's exit status, if it has finished (with several, the one shown)")
         ("m,message", "text to show instead of viewing a file", cxxopts::value<std::string>())
         ("f,font_size", "font size in pixels", cxxopts::value<int>())
         ("t,title", "window title (filename by default)", cxxopts::value<std::string>())
         ("y,yes_button", "shows a yes button with different exit code")
         ("e,error_display", "format as error, background will be red")
-        ("w,wrap_lines", "wrap long lines of text. WARNING: could be slow for large files!")
+        ("w,wrap_lines", "wrap long lines of text")
+        ("follow", "keep showing text appended to input_file, like tail -F")
+        ("max_lines", "only keep this many lines of script output, standard input, decompressed or followed text", cxxopts::value<int>())
+        ("max_bytes", "only keep this many bytes of script output, standard input, decompressed or followed text (default for decompressed or converted text: 128 MB)", cxxopts::value<int>())
+        ("encoding", "character encoding of the text, e.g. latin1 or cp1252 (default: UTF-8)", cxxopts::value<std::string>())
+        ("cache_mb", "memory for mapped text and cached line positions of all large files together (default: 16)", cxxopts::value<int>())
+        ("max_fps", "limit the frame rate to this value (default: display refresh rate)", cxxopts::value<int>())
+        ("idle_fps", "frame rate while nothing changes on screen (default: only draw when something changes)", cxxopts::value<int>())
+        ("read_budget_ms", "read script output on the UI thread, spending at most this many milliseconds per frame (default: read on a background thread)", cxxopts::value<int>())
+        ("perf_overlay", "show frame timings and counters on top of the text")
+        ("perf_log", "write frame timings and counters of the last frames to this CSV file on exit", cxxopts::value<std::string>())
         ("h,help", "show help")
       ;
 
@@ -72,13 +152,41 @@ std::optional<cxxopts::ParseResult> parseArgs(int argc, char** argv)
         std::exit(0);
       }
 
-      if (!result.count("input_file") && !result.count("message") && !result.count("script_file"))
+      if (
+        !result.count("input_file") &&
+        !result.count("stdin") &&
+        !result.count("message") &&
+        !result.count("script_file"))
       {
         std::cerr << "Error: No input given\n\n";
         std::cerr << options.help({""}) << '\n';
         return {};
       }
 
+      for (const auto& name : {"max_fps", "idle_fps", "max_lines", "max_bytes", "cache_mb"})
+      {
+        if (result.count(name) && result[name].as<int>() <= 0)
+        {
+          std::cerr << "Error: " << name << " must be greater than zero\n\n";
+          std::cerr << options.help({""}) << '\n';
+          return {};
+        }
+      }
+
+      if (result.count("follow") && (!result.count("input_file") || readsStdin(result)))
+      {
+        std::cerr << "Error: follow needs an input_file\n\n";
+        std::cerr << options.help({""}) << '\n';
+        return {};
+      }
+
+      if (readsStdin(result) && inputCount(result) > 1)
+      {
+        std::cerr << "Error: Cannot use stdin together with another input\n\n";
+        std::cerr << options.help({""}) << '\n';
+        return {};
+      }
+
       if (result.count("input_file") && result.count("message"))
       {
         std::cerr << "Error: Cannot use input_file and message at the same time\n\n";
@@ -86,6 +194,20 @@ std::optional<cxxopts::ParseResult> parseArgs(int argc, char** argv)
         return {};
       }
 
+      if (result.count("encoding"))
+      {
+        try
+        {
+          TextDecoder{result["encoding"].as<std::string>()};
+        }
+        catch (const std::runtime_error& e)
+        {
+          std::cerr << "Error: " << e.what() << "\n\n";
+          std::cerr << options.help({""}) << '\n';
+          return {};
+        }
+      }
+
       return result;
     }
     catch (const cxxopts::OptionParseException& e)
@@ -136,137 +258,684 @@ std::string replaceEscapeSequences(const std::string& original)
 }
 
 
-std::string readInputOrScriptName(const cxxopts::ParseResult& args)
+/** One of the texts or scripts to show. Each is shown in its own tab. */
+struct Input {
+  std::string title;
+  std::string tabLabel;
+  TextBuffer textOrScriptFile;
+  InputSource source;
+  std::string followedPath;
+};
+
+
+std::optional<int> optionalInt(
+  const cxxopts::ParseResult& args,
+  const std::string& name)
 {
-  if (args.count("input_file"))
+  if (args.count(name))
   {
-    const auto& inputFilename = args["input_file"].as<std::string>();
-    std::ifstream file(inputFilename, std::ios::ate);
-    if (!file.is_open())
+    return args[name].as<int>();
+  }
+
+  return {};
+}
+
+
+/** Cache memory for each file shown. Only files use it, so it's split
+  * between them, to bound the memory of all tabs together.
+  */
+std::size_t determineCacheSize(const cxxopts::ParseResult& args)
+{
+  const auto totalSize =
+    std::size_t(optionalInt(args, "cache_mb").value_or(DEFAULT_CACHE_MB)) * 1024 * 1024;
+  return totalSize / std::max<std::size_t>(stringsArg(args, "input_file").size(), 1);
+}
+
+
+std::vector<Input> determineInputs(const cxxopts::ParseResult& args)
+{
+  const auto defaultTitle = std::string{
+    args.count("error_display") ? "Error!!" : "Info"};
+
+  std::vector<Input> inputs;
+
+  // Read as it arrives, by the view itself
+  if (readsStdin(args))
+  {
+    inputs.push_back(
+      {defaultTitle, defaultTitle, TextBuffer{}, InputSource::Stdin, {}});
+  }
+  else
+  {
+    for (const auto& path : stringsArg(args, "input_file"))
     {
-      return {};
+      // A file which can't be read is shown as empty.
+      auto text = TextBuffer{};
+      try
+      {
+        text = TextBuffer::mapFile(path, determineCacheSize(args) / 2);
+      }
+      catch (const std::runtime_error&)
+      {
+      }
+
+      const auto source =
+        detectCompression(text) != Compression::None
+        ? InputSource::CompressedFile
+        : InputSource::Text;
+      inputs.push_back(
+        {path, path, std::move(text), source, args.count("follow") ? path : std::string{}});
     }
 
-    const auto fileSize = file.tellg();
-    file.seekg(0);
+    for (const auto& script : stringsArg(args, "script_file"))
+    {
+      inputs.push_back(
+        {script, script, TextBuffer{script}, InputSource::ScriptFile, {}});
+    }
 
-    std::string inputText;
-    inputText.resize(fileSize);
-    file.read(&inputText[0], fileSize);
+    if (inputs.empty() && args.count("message"))
+    {
+      inputs.push_back({
+        defaultTitle,
+        defaultTitle,
+        TextBuffer{replaceEscapeSequences(args["message"].as<std::string>())},
+        InputSource::Text,
+        {}});
+    }
 
-    return inputText;
+    // Only tabs need the script to tell them apart.
+    if (inputs.size() == 1 && inputs.front().source == InputSource::ScriptFile)
+    {
+      inputs.front().title = defaultTitle;
+    }
   }
-  else if (args.count("script_file"))
+
+  if (args.count("title"))
   {
-    return args["script_file"].as<std::string>();
+    for (auto& input : inputs)
+    {
+      input.title = args["title"].as<std::string>();
+    }
   }
-  else
+
+  return inputs;
+}
+
+
+std::optional<StreamReader::Clock::duration> determineReadBudget(
+  const cxxopts::ParseResult& args)
+{
+  if (args.count("read_budget_ms"))
   {
-    return replaceEscapeSequences(args["message"].as<std::string>());
+    return std::chrono::milliseconds{args["read_budget_ms"].as<int>()};
   }
+
+  return {};
 }
 
 
-std::string determineTitle(const cxxopts::ParseResult& args)
+ScrollbackLimits determineScrollbackLimits(const cxxopts::ParseResult& args)
 {
-  if (args.count("title"))
+  ScrollbackLimits limits;
+
+  if (args.count("max_lines"))
   {
-    return args["title"].as<std::string>();
+    limits.maxLines = args["max_lines"].as<int>();
   }
-  else if (args.count("input_file"))
+
+  if (args.count("max_bytes"))
   {
-    return args["input_file"].as<std::string>();
+    limits.maxBytes = args["max_bytes"].as<int>();
   }
-  else if (args.count("error_display"))
+
+  return limits;
+}
+
+
+std::string determineEncoding(const cxxopts::ParseResult& args)
+{
+  // Messages come from the command line, and are UTF-8 like the title.
+  if (args.count("encoding") && !args.count("message"))
   {
-    return "Error!!";
+    return args["encoding"].as<std::string>();
   }
-  else
+
+  return {};
+}
+
+
+std::optional<std::uint64_t> availableMemory()
+{
+  std::ifstream memoryInfo("/proc/meminfo");
+  std::string name;
+  std::uint64_t sizeKb;
+  while (memoryInfo >> name >> sizeKb)
+  {
+    if (name == "MemAvailable:")
+    {
+      return sizeKb * 1024;
+    }
+
+    memoryInfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+
+  return {};
+}
+
+
+bool isInputHeld(const ImGuiIO& io, const GameControllers& gameControllers)
+{
+  return
+    gameControllers.isInputHeld() ||
+    std::any_of(std::begin(io.KeysDown), std::end(io.KeysDown), [](const bool down) { return down; }) ||
+    std::any_of(std::begin(io.MouseDown), std::end(io.MouseDown), [](const bool down) { return down; });
+}
+
+
+void rebuildFontAtlas(DynamicFontAtlas& fontAtlas)
+{
+  // The renderer creates the texture on the first frame. Until then,
+  // there's nothing to replace.
+  const auto hasTexture = ImGui::GetIO().Fonts->TexID != nullptr;
+  if (hasTexture)
+  {
+    ImGui_ImplOpenGL3_DestroyFontsTexture();
+  }
+
+  fontAtlas.rebuild();
+
+  if (hasTexture)
   {
-    return "Info";
+    ImGui_ImplOpenGL3_CreateFontsTexture();
   }
 }
 
 
-int run(SDL_Window* pWindow, const cxxopts::ParseResult& args)
+int run(
+  SDL_Window* pWindow,
+  DynamicFontAtlas& fontAtlas,
+  PerfRecorder* pPerfRecorder,
+  const cxxopts::ParseResult& args)
 {
-  std::vector<SDL_GameController*> gameControllers;
+  GameControllers gameControllers;
 
-  auto clearGameControllers = [&]()
+  // Used by the script reader and file follower threads to wake us up when
+  // there's new text.
+  const auto newTextEventType = SDL_RegisterEvents(1);
+  auto notifyNewText = [newTextEventType]()
   {
-    for (const auto pController : gameControllers)
+    SDL_Event event{};
+    event.type = newTextEventType;
+    SDL_PushEvent(&event);
+  };
+
+  auto inputs = determineInputs(args);
+
+  // Appended compressed data can't be decompressed on its own.
+  if (
+    args.count("follow") &&
+    std::any_of(inputs.begin(), inputs.end(), [](const Input& input)
+      {
+        return input.source == InputSource::CompressedFile;
+      }))
+  {
+    std::cerr << "Error: follow doesn't work with compressed files\n";
+    return -2;
+  }
+
+  // All documents share the window, GL context and font atlas. Each view
+  // keeps its own text, line index and layout.
+  struct Document {
+    std::string tabLabel;
+    std::unique_ptr<View> pView;
+  };
+
+  std::vector<Document> documents;
+  for (auto& input : inputs)
+  {
+    // Text the follower finds beyond what we've read so far is new.
+    auto pFileFollower = std::unique_ptr<FileFollower>{};
+    if (!input.followedPath.empty())
     {
-      SDL_GameControllerClose(pController);
+      try
+      {
+        pFileFollower = std::make_unique<FileFollower>(
+          input.followedPath, input.textOrScriptFile.size(), notifyNewText);
+      }
+      catch (const std::runtime_error& error)
+      {
+        std::cerr << "Error: Cannot follow " << input.followedPath << ": " << error.what() << '\n';
+        return -2;
+      }
     }
 
-    gameControllers.clear();
+    // Windows with the same title would share their state, like the
+    // scroll position.
+    const auto id = "##" + std::to_string(documents.size());
+    auto title = inputs.size() > 1 ? input.title + id : input.title;
+
+    documents.push_back({
+      input.tabLabel + id,
+      std::make_unique<View>(
+        std::move(title),
+        std::move(input.textOrScriptFile),
+        args.count("yes_button") > 0,
+        args.count("wrap_lines") > 0,
+        input.source,
+        determineReadBudget(args),
+        args.count("kill_on_exit") > 0,
+        determineScrollbackLimits(args),
+        determineCacheSize(args) / 2,
+        determineCacheSize(args) / 2,
+        determineEncoding(args),
+        notifyNewText,
+        std::move(pFileFollower),
+        &fontAtlas)});
+  }
+
+  auto activeDocument = std::size_t{0};
+  auto view = [&]() -> View& { return *documents[activeDocument].pView; };
+
+  const auto& io = ImGui::GetIO();
+
+  const auto showPerfOverlay = pPerfRecorder && args.count("perf_overlay");
+  auto markPerfStage = [pPerfRecorder](const PerfStage stage)
+  {
+    if (pPerfRecorder)
+    {
+      pPerfRecorder->mark(stage);
+    }
   };
 
-  auto enumerateGameControllers = [&]()
+  const auto maxFps = optionalInt(args, "max_fps");
+  const auto idleFps = optionalInt(args, "idle_fps");
+  const auto minFrameTicks = Uint32(maxFps ? 1000 / *maxFps : 0);
+  const auto idleTimeout = idleFps ? 1000 / *idleFps : -1;
+
+  // Keep rendering for a few frames after anything happened. Some changes,
+  // like scrolling to a new focus item, only take effect a frame later.
+  auto framesToRender = SETTLE_FRAMES;
+
+  // Left and right trigger, to act only once per pull
+  bool triggerPressed[2] = {false, false};
+
+  // Shoulder button held on its own so far, which switches tabs when
+  // released
+  std::optional<Uint8> tappedShoulder;
+
+  // Set when switching tabs other than by clicking them, until the tab bar
+  // shows the new tab as selected.
+  auto selectTab = false;
+  std::optional<std::size_t> clickedDocument;
+
+  auto switchToDocument = [&](const std::size_t index)
   {
-    clearGameControllers();
+    if (index == activeDocument)
+    {
+      return;
+    }
 
-    for (std::uint8_t i = 0; i < SDL_NumJoysticks(); ++i) {
-      if (SDL_IsGameController(i)) {
-        gameControllers.push_back(SDL_GameControllerOpen(i));
+    // Documents in other tabs only keep their caches while there's memory
+    // to spare.
+    const auto memory = availableMemory();
+    if (memory && *memory < LOW_MEMORY_SIZE)
+    {
+      for (auto i = std::size_t{0}; i < documents.size(); ++i)
+      {
+        if (i != index)
+        {
+          documents[i].pView->releaseCaches();
+        }
       }
     }
+
+    activeDocument = index;
+    framesToRender = SETTLE_FRAMES;
   };
 
+  auto switchDocument = [&](const int direction)
+  {
+    const auto count = documents.size();
+    switchToDocument((activeDocument + count + direction) % count);
+    selectTab = true;
+  };
 
-  auto view = View{
-    determineTitle(args),
-    readInputOrScriptName(args),
-    args.count("yes_button") > 0,
-    args.count("wrap_lines") > 0,
-    args.count("script_file") > 0};
+  const auto drawTabs = [&]()
+  {
+    if (!ImGui::BeginTabBar("documents", ImGuiTabBarFlags_FittingPolicyScroll))
+    {
+      return;
+    }
 
-  const auto& io = ImGui::GetIO();
+    for (auto i = std::size_t{0}; i < documents.size(); ++i)
+    {
+      const auto flags = selectTab && i == activeDocument
+        ? ImGuiTabItemFlags_SetSelected
+        : ImGuiTabItemFlags_None;
+      if (ImGui::BeginTabItem(documents[i].tabLabel.c_str(), nullptr, flags))
+      {
+        if (i == activeDocument)
+        {
+          selectTab = false;
+        }
+        else if (!selectTab)
+        {
+          clickedDocument = i;
+        }
+
+        ImGui::EndTabItem();
+      }
+    }
+
+    ImGui::EndTabBar();
+  };
+  const auto drawTabsIfNeeded = documents.size() > 1
+    ? std::function<void()>{drawTabs}
+    : std::function<void()>{};
+
+
+  // Returns false if the user asked to quit
+  auto handleEvent = [&](const SDL_Event& event)
+  {
+    // Only wakes us up, updating the views decides whether to draw a new frame.
+    if (event.type == newTextEventType)
+    {
+      return true;
+    }
+
+    ImGui_ImplSDL2_ProcessEvent(&event);
+    gameControllers.handleEvent(event);
+    if (
+      event.type == SDL_QUIT ||
+      (event.type == SDL_CONTROLLERBUTTONDOWN &&
+       (event.cbutton.button == SDL_CONTROLLER_BUTTON_GUIDE || event.cbutton.button == SDL_CONTROLLER_BUTTON_BACK)) ||
+      (event.type == SDL_WINDOWEVENT &&
+       event.window.event == SDL_WINDOWEVENT_CLOSE &&
+       event.window.windowID == SDL_GetWindowID(pWindow))
+    ) {
+      return false;
+    }
+
+    // Search: X or Ctrl+F opens it, the triggers or (Shift+)F3 go to the
+    // next/previous match. Without matches, the triggers page up and
+    // down, or jump to the start/end while holding RB. X also shows an
+    // on-screen keyboard for typing the query.
+    if (event.type == SDL_CONTROLLERBUTTONDOWN && event.cbutton.button == SDL_CONTROLLER_BUTTON_X)
+    {
+      view().openSearch(true);
+    }
+
+    if (
+      event.type == SDL_KEYDOWN &&
+      event.key.keysym.sym == SDLK_f &&
+      (event.key.keysym.mod & KMOD_CTRL))
+    {
+      view().openSearch(false);
+    }
+
+    if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F3)
+    {
+      view().jumpToMatch((event.key.keysym.mod & KMOD_SHIFT) ? -1 : 1);
+    }
+
+    if (
+      event.type == SDL_CONTROLLERAXISMOTION &&
+      (event.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERLEFT ||
+       event.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERRIGHT))
+    {
+      const auto isRight = event.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERRIGHT;
+      const auto isPressed = event.caxis.value > TRIGGER_THRESHOLD;
+      if (isPressed && !triggerPressed[isRight])
+      {
+        if (view().hasSearchMatches())
+        {
+          view().jumpToMatch(isRight ? 1 : -1);
+        }
+        else if (gameControllers.isButtonHeld(SDL_CONTROLLER_BUTTON_RIGHTSHOULDER))
+        {
+          view().scrollToFraction(isRight ? 1.0f : 0.0f);
+        }
+        else
+        {
+          view().scrollPages(isRight ? 1 : -1);
+        }
+      }
+
+      triggerPressed[isRight] = isPressed;
+    }
+
+    // Tabs: LB/RB on their own or Ctrl+PageUp/PageDown switch to the
+    // previous/next one. Together with other buttons, or while moving a
+    // stick, LB/RB are modifiers instead.
+    if (
+      event.type == SDL_CONTROLLERAXISMOTION &&
+      std::abs(event.caxis.value) > GameControllers::DEAD_ZONE)
+    {
+      tappedShoulder.reset();
+    }
+
+    if (event.type == SDL_CONTROLLERBUTTONDOWN)
+    {
+      const auto button = event.cbutton.button;
+      tappedShoulder =
+        button == SDL_CONTROLLER_BUTTON_LEFTSHOULDER ||
+        button == SDL_CONTROLLER_BUTTON_RIGHTSHOULDER
+        ? std::optional<Uint8>{button}
+        : std::nullopt;
+    }
+
+    if (event.type == SDL_CONTROLLERBUTTONUP && tappedShoulder == event.cbutton.button)
+    {
+      switchDocument(
+        event.cbutton.button == SDL_CONTROLLER_BUTTON_RIGHTSHOULDER ? 1 : -1);
+      tappedShoulder.reset();
+    }
+
+    if (
+      event.type == SDL_KEYDOWN &&
+      (event.key.keysym.sym == SDLK_PAGEUP || event.key.keysym.sym == SDLK_PAGEDOWN) &&
+      (event.key.keysym.mod & KMOD_CTRL))
+    {
+      switchDocument(event.key.keysym.sym == SDLK_PAGEDOWN ? 1 : -1);
+    }
+
+    // Bookmarks: R3 or Ctrl+B adds or removes one, L3 or (Shift+)F2 goes
+    // to the next/previous one, L3 while holding LB to the previous one.
+    if (
+      (event.type == SDL_CONTROLLERBUTTONDOWN &&
+       event.cbutton.button == SDL_CONTROLLER_BUTTON_RIGHTSTICK) ||
+      (event.type == SDL_KEYDOWN &&
+       event.key.keysym.sym == SDLK_b &&
+       (event.key.keysym.mod & KMOD_CTRL)))
+    {
+      view().toggleBookmark();
+    }
+
+    if (
+      event.type == SDL_CONTROLLERBUTTONDOWN &&
+      event.cbutton.button == SDL_CONTROLLER_BUTTON_LEFTSTICK)
+    {
+      view().jumpToBookmark(
+        gameControllers.isButtonHeld(SDL_CONTROLLER_BUTTON_LEFTSHOULDER) ? -1 : 1);
+    }
+
+    if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F2)
+    {
+      view().jumpToBookmark((event.key.keysym.mod & KMOD_SHIFT) ? -1 : 1);
+    }
+
+    framesToRender = SETTLE_FRAMES;
+    return true;
+  };
+
+  // Closing the viewer normally results in 0, or optionally the exit
+  // status of the script in the tab shown.
+  auto closedExitCode = [&]()
+  {
+    return args.count("script_exit_code")
+      ? view().scriptExitStatus().value_or(0)
+      : 0;
+  };
 
   std::optional<int> exitCode;
   while (!exitCode)
   {
     SDL_Event event;
+
+    // Nothing has changed since the last frame, so there's no point in
+    // drawing another one. Sleep until there's input or new text to show
+    // instead. Without a reader thread, we need to wake up regularly to look
+    // for new output.
+    if (framesToRender == 0)
+    {
+      const auto needsPolling = std::any_of(
+        documents.begin(),
+        documents.end(),
+        [](const Document& document) { return document.pView->needsPolling(); });
+      const auto timeout = needsPolling ? SCRIPT_POLL_INTERVAL : idleTimeout;
+
+      if (SDL_WaitEventTimeout(&event, timeout))
+      {
+        if (!handleEvent(event))
+        {
+          return closedExitCode();
+        }
+      }
+      else if (idleTimeout >= 0)
+      {
+        framesToRender = 1;
+      }
+    }
+
+    // Time spent waiting for events above is idle time, not part of the
+    // frame.
+    if (pPerfRecorder)
+    {
+      pPerfRecorder->beginFrame();
+    }
+
     while (SDL_PollEvent(&event))
     {
-      ImGui_ImplSDL2_ProcessEvent(&event);
-      if (
-        event.type == SDL_QUIT ||
-        (event.type == SDL_CONTROLLERBUTTONDOWN &&
-         (event.cbutton.button == SDL_CONTROLLER_BUTTON_GUIDE || event.cbutton.button == SDL_CONTROLLER_BUTTON_BACK)) ||
-        (event.type == SDL_WINDOWEVENT &&
-         event.window.event == SDL_WINDOWEVENT_CLOSE &&
-         event.window.windowID == SDL_GetWindowID(pWindow))
-      ) {
-        return 0;
+      if (!handleEvent(event))
+      {
+        return closedExitCode();
       }
+    }
 
-      if (
-        event.type == SDL_CONTROLLERDEVICEADDED ||
-        event.type == SDL_CONTROLLERDEVICEREMOVED)
+    // The right stick's deflection sets the scrubbing speed, relative to
+    // the length of the text.
+    const auto rightStickY = gameControllers.axis(SDL_CONTROLLER_AXIS_RIGHTY);
+    if (std::abs(rightStickY) > GameControllers::DEAD_ZONE)
+    {
+      const auto deflection =
+        (std::abs(rightStickY) - GameControllers::DEAD_ZONE) /
+        float(32767 - GameControllers::DEAD_ZONE);
+      view().scrollByFraction(
+        std::copysign(std::min(deflection, 1.0f), float(rightStickY)) *
+        io.DeltaTime / SCRUB_DURATION);
+      framesToRender = SETTLE_FRAMES;
+    }
+
+    markPerfStage(PerfStage::Events);
+
+    // Documents in other tabs keep reading too, but only new text in the
+    // one shown needs a new frame.
+    for (auto& document : documents)
+    {
+      if (document.pView->update() && document.pView.get() == &view())
       {
-        enumerateGameControllers();
+        framesToRender = SETTLE_FRAMES;
       }
     }
 
+    markPerfStage(PerfStage::Update);
+
+    if (framesToRender == 0)
+    {
+      continue;
+    }
+
+    --framesToRender;
+
+    const auto frameStartTicks = SDL_GetTicks();
+
+    // The last frame showed characters we don't have glyphs for yet.
+    if (fontAtlas.needsRebuild())
+    {
+      rebuildFontAtlas(fontAtlas);
+      for (auto& document : documents)
+      {
+        document.pView->invalidateLayout();
+      }
+
+      framesToRender = SETTLE_FRAMES;
+    }
+
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame(pWindow, gameControllers);
     ImGui::NewFrame();
 
+    // Held buttons and analog sticks keep scrolling without generating
+    // any events, so keep going until they are released.
+    if (isInputHeld(io, gameControllers))
+    {
+      framesToRender = SETTLE_FRAMES;
+    }
+
     // Draw the UI
-    exitCode = view.draw(io.DisplaySize);
+    exitCode = view().draw(io.DisplaySize, drawTabsIfNeeded);
+
+    if (showPerfOverlay)
+    {
+      pPerfRecorder->drawOverlay();
+    }
+
+    markPerfStage(PerfStage::Draw);
 
     // Rendering
     ImGui::Render();
+    markPerfStage(PerfStage::Render);
+
     glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    markPerfStage(PerfStage::RenderDrawData);
+
     SDL_GL_SwapWindow(pWindow);
+    markPerfStage(PerfStage::Swap);
+
+    if (pPerfRecorder)
+    {
+      // Documents in other tabs keep reading, and the total must not go
+      // down when switching tabs.
+      auto bytesIngested = std::uint64_t{0};
+      for (const auto& document : documents)
+      {
+        bytesIngested += document.pView->bytesIngested();
+      }
+
+      pPerfRecorder->endFrame(
+        bytesIngested, view().rowsSubmitted(), *ImGui::GetDrawData());
+    }
+
+    // Switching takes effect with the next frame, the previous tab has
+    // been drawn already.
+    if (clickedDocument)
+    {
+      switchToDocument(*clickedDocument);
+      clickedDocument.reset();
+    }
+
+    const auto frameTicks = SDL_GetTicks() - frameStartTicks;
+    if (frameTicks < minFrameTicks)
+    {
+      SDL_Delay(minFrameTicks - frameTicks);
+    }
   }
 
-  return *exitCode;
+  return *exitCode == 0 ? closedExitCode() : *exitCode;
 }
 
 }
@@ -333,7 +1002,6 @@ int main(int argc, char** argv)
   auto& io = ImGui::GetIO();
   io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
   io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
-  io.Fonts->AddFontFromFileTTF("/storage/.config/retroarch/regular.ttf", 50.0f, NULL, io.Fonts->GetGlyphRangesChineseSimplifiedCommon());
 
   // Disable creation of imgui.ini
   io.IniFilename = nullptr;
@@ -346,20 +1014,43 @@ int main(int argc, char** argv)
     ImGui::PushStyleColor(ImGuiCol_TitleBgActive, ImVec4(ImColor(94, 11, 22, 255)));
   }
 
-  if (args.count("font_size"))
-  {
-    ImFontConfig config;
-    config.SizePixels = args["font_size"].as<int>();
-    ImGui::GetIO().Fonts->AddFontDefault(&config);
-    //io.Fonts->AddFontFromFileTTF("/storage/.config/retroarch/regular.ttf", 13.0f, NULL, io.Fonts->GetGlyphRangesChineseSimplifiedCommon());
-  }
+  // Glyphs are added to the atlas as they are needed
+  auto fontAtlas = DynamicFontAtlas{
+    io.Fonts,
+    FONT_PATH,
+    float(optionalInt(args, "font_size").value_or(DEFAULT_FONT_SIZE))};
 
   // Setup Platform/Renderer bindings
   ImGui_ImplSDL2_InitForOpenGL(pWindow, pGlContext);
   ImGui_ImplOpenGL3_Init(nullptr);
 
-  // Main loop
-  const auto exitCode = run(pWindow, args);
+  // Only recording when asked to, so that normal use doesn't pay for it
+  auto pPerfRecorder = args.count("perf_overlay") || args.count("perf_log")
+    ? std::make_unique<PerfRecorder>()
+    : nullptr;
+
+  // Main loop. Errors end it, but still need the cleanup below.
+  auto exitCode = -1;
+  try
+  {
+    exitCode = run(pWindow, fontAtlas, pPerfRecorder.get(), args);
+  }
+  catch (const std::exception& error)
+  {
+    std::cerr << "Error: " << error.what() << '\n';
+  }
+
+  if (args.count("perf_log"))
+  {
+    try
+    {
+      pPerfRecorder->writeCsv(args["perf_log"].as<std::string>());
+    }
+    catch (const std::exception& error)
+    {
+      std::cerr << "Error: " << error.what() << '\n';
+    }
+  }
 
   // Cleanup
   ImGui_ImplOpenGL3_Shutdown();
@@ -0,0 +1,86 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+/** Call func(const char* pNewline) for each '\n' in [pBegin, pEnd).
+  *
+  * Looks at 16 bytes at a time where SSE2 or NEON are available. Unlike
+  * calling memchr() once per line, this doesn't pay a function call for
+  * every (typically short) line of a log file.
+  */
+template <typename Func>
+void forEachNewline(const char* pBegin, const char* pEnd, Func&& func)
+{
+  auto p = pBegin;
+
+#if defined(__SSE2__)
+  const auto newlines = _mm_set1_epi8('\n');
+  for (; pEnd - p >= 16; p += 16)
+  {
+    const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    auto mask = static_cast<std::uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(block, newlines)));
+
+    while (mask)
+    {
+      func(p + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+#elif defined(__ARM_NEON)
+  const auto newlines = vdupq_n_u8('\n');
+  for (; pEnd - p >= 16; p += 16)
+  {
+    const auto block = vld1q_u8(reinterpret_cast<const std::uint8_t*>(p));
+    const auto matches = vceqq_u8(block, newlines);
+
+    // NEON has no movemask. Narrowing each 16 bit lane by 4 yields a 64 bit
+    // value with 4 bits per input byte instead.
+    auto mask = vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+
+    while (mask)
+    {
+      const auto bit = __builtin_ctzll(mask);
+      func(p + (bit >> 2));
+      mask &= ~(std::uint64_t{0xF} << (bit & ~3));
+    }
+  }
+#endif
+
+  while (const auto pNewline = static_cast<const char*>(
+    std::memchr(p, '\n', pEnd - p)))
+  {
+    func(pNewline);
+    p = pNewline + 1;
+  }
+}
@@ -0,0 +1,210 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+#include "perf_stats.hpp"
+
+#include "imgui.h"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+
+namespace
+{
+
+// Frames averaged for the overlay
+constexpr auto OVERLAY_FRAMES = std::uint64_t{60};
+
+constexpr const char* STAGE_NAMES[] = {
+  "events",
+  "update",
+  "draw",
+  "render",
+  "render_draw_data",
+  "swap",
+};
+
+static_assert(std::size(STAGE_NAMES) == std::size_t(PerfStage::Count));
+
+}
+
+
+PerfRecorder::PerfRecorder()
+  : mTicksPerMs(SDL_GetPerformanceFrequency() / 1000.0)
+{
+}
+
+
+void PerfRecorder::beginFrame()
+{
+  mCurrentFrame = {};
+  mLastMark = SDL_GetPerformanceCounter();
+}
+
+
+void PerfRecorder::mark(const PerfStage stage)
+{
+  const auto now = SDL_GetPerformanceCounter();
+  mCurrentFrame.stageTicks[std::size_t(stage)] += now - mLastMark;
+  mLastMark = now;
+}
+
+
+void PerfRecorder::endFrame(
+  const std::uint64_t bytesIngested,
+  const std::size_t rowsSubmitted,
+  const ImDrawData& drawData)
+{
+  mCurrentFrame.bytesIngested = bytesIngested - mLastBytesIngested;
+  mCurrentFrame.rowsSubmitted = rowsSubmitted;
+  mCurrentFrame.vertexCount = drawData.TotalVtxCount;
+  mCurrentFrame.indexCount = drawData.TotalIdxCount;
+  mLastBytesIngested = bytesIngested;
+
+  const auto frameCount = mFrameCount.load(std::memory_order_relaxed);
+  mFrames[frameCount % CAPACITY] = mCurrentFrame;
+  mFrameCount.store(frameCount + 1, std::memory_order_release);
+}
+
+
+void PerfRecorder::drawOverlay() const
+{
+  const auto frameCount = mFrameCount.load(std::memory_order_acquire);
+  const auto framesAveraged = std::min(frameCount, OVERLAY_FRAMES);
+  if (framesAveraged == 0)
+  {
+    return;
+  }
+
+  auto average = FrameStats{};
+  for (auto i = frameCount - framesAveraged; i < frameCount; ++i)
+  {
+    const auto& frame = mFrames[i % CAPACITY];
+    for (auto stage = std::size_t{0}; stage < frame.stageTicks.size(); ++stage)
+    {
+      average.stageTicks[stage] += frame.stageTicks[stage];
+    }
+
+    average.bytesIngested += frame.bytesIngested;
+    average.rowsSubmitted += frame.rowsSubmitted;
+    average.vertexCount += frame.vertexCount;
+    average.indexCount += frame.indexCount;
+  }
+
+  auto totalTicks = std::uint64_t{0};
+  for (const auto ticks : average.stageTicks)
+  {
+    totalTicks += ticks;
+  }
+
+  char text[512];
+  auto length = std::snprintf(
+    text,
+    sizeof(text),
+    "frame %.2f ms\n",
+    ticksToMs(totalTicks) / framesAveraged);
+  for (auto stage = std::size_t{0}; stage < average.stageTicks.size(); ++stage)
+  {
+    length += std::snprintf(
+      text + length,
+      sizeof(text) - length,
+      "%s %.2f ms\n",
+      STAGE_NAMES[stage],
+      ticksToMs(average.stageTicks[stage]) / framesAveraged);
+  }
+
+  std::snprintf(
+    text + length,
+    sizeof(text) - length,
+    "%d vertices, %d indices\n%zu rows, %llu bytes in",
+    int(average.vertexCount / framesAveraged),
+    int(average.indexCount / framesAveraged),
+    std::size_t(average.rowsSubmitted / framesAveraged),
+    static_cast<unsigned long long>(average.bytesIngested / framesAveraged));
+
+  // Drawn straight into the foreground draw list, so that it's always on
+  // top and never takes focus or input away from the viewer's window.
+  const auto pDrawList = ImGui::GetForegroundDrawList();
+  const auto padding = ImGui::GetFontSize() / 4.0f;
+  const auto textSize = ImGui::CalcTextSize(text);
+  const auto position = ImVec2{
+    ImGui::GetIO().DisplaySize.x - textSize.x - padding * 3.0f,
+    padding};
+  pDrawList->AddRectFilled(
+    position,
+    {position.x + textSize.x + padding * 2.0f, position.y + textSize.y + padding * 2.0f},
+    IM_COL32(0, 0, 0, 192));
+  pDrawList->AddText(
+    {position.x + padding, position.y + padding},
+    IM_COL32(255, 255, 255, 255),
+    text);
+}
+
+
+void PerfRecorder::writeCsv(const std::string& path) const
+{
+  std::ofstream file(path);
+  if (!file.is_open())
+  {
+    throw std::runtime_error("Failed to open performance log file");
+  }
+
+  file << "frame";
+  for (const auto name : STAGE_NAMES)
+  {
+    file << ',' << name << "_ms";
+  }
+  file << ",bytes_ingested,rows_submitted,vertices,indices\n";
+
+  const auto frameCount = mFrameCount.load(std::memory_order_acquire);
+  for (auto i = frameCount - std::min(frameCount, CAPACITY); i < frameCount; ++i)
+  {
+    const auto& frame = mFrames[i % CAPACITY];
+    file << i;
+    for (const auto ticks : frame.stageTicks)
+    {
+      file << ',' << ticksToMs(ticks);
+    }
+
+    file
+      << ',' << frame.bytesIngested
+      << ',' << frame.rowsSubmitted
+      << ',' << frame.vertexCount
+      << ',' << frame.indexCount << '\n';
+  }
+
+  if (!file)
+  {
+    throw std::runtime_error("Error writing performance log file");
+  }
+}
+
+
+double PerfRecorder::ticksToMs(const std::uint64_t ticks) const
+{
+  return ticks / mTicksPerMs;
+}
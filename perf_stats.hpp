@@ -0,0 +1,111 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+struct ImDrawData;
+
+
+/** Parts of a frame which are timed separately. */
+enum class PerfStage {
+  Events,
+  Update,
+  Draw,
+  Render,
+  RenderDrawData,
+  Swap,
+  Count
+};
+
+
+/** Timings and counters recorded for one frame. */
+struct FrameStats {
+  // In performance counter ticks, indexed by PerfStage
+  std::array<std::uint64_t, std::size_t(PerfStage::Count)> stageTicks{};
+  std::uint64_t bytesIngested = 0;
+  std::size_t rowsSubmitted = 0;
+  int vertexCount = 0;
+  int indexCount = 0;
+};
+
+
+/** Records where the time goes in each frame.
+  *
+  * Stats for the most recent frames are kept in a fixed size ring, so
+  * recording never allocates. Only the UI thread records; the frame count
+  * is published atomically, so readers never see a partially recorded
+  * frame unless they fall a whole ring behind.
+  *
+  * The stats can be shown as an overlay while running, and written to a
+  * CSV file for comparing devices and builds.
+  */
+class PerfRecorder {
+public:
+  static constexpr auto CAPACITY = std::size_t{8192};
+
+  PerfRecorder();
+
+  PerfRecorder(const PerfRecorder&) = delete;
+  PerfRecorder& operator=(const PerfRecorder&) = delete;
+
+  /** Start timing a new frame, discarding a frame that wasn't finished. */
+  void beginFrame();
+
+  /** Attribute the time since the previous mark to the given stage. */
+  void mark(PerfStage stage);
+
+  /** Finish the current frame and store it in the ring.
+    *
+    * bytesIngested is the total number of bytes read so far, the frame's
+    * share is derived from that. It must never decrease.
+    */
+  void endFrame(
+    std::uint64_t bytesIngested,
+    std::size_t rowsSubmitted,
+    const ImDrawData& drawData);
+
+  /** Draw averages over the last second or so on top of everything else.
+    * Must be called while a frame is in progress.
+    */
+  void drawOverlay() const;
+
+  /** Write all frames still in the ring as CSV. Throws on failure. */
+  void writeCsv(const std::string& path) const;
+
+private:
+  double ticksToMs(std::uint64_t ticks) const;
+
+  std::array<FrameStats, CAPACITY> mFrames;
+  std::atomic<std::uint64_t> mFrameCount{0};
+
+  FrameStats mCurrentFrame;
+  std::uint64_t mLastMark = 0;
+  std::uint64_t mLastBytesIngested = 0;
+  double mTicksPerMs;
+};
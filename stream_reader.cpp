@@ -0,0 +1,264 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "stream_reader.hpp"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+
+namespace
+{
+
+constexpr auto BUFFER_SIZE = std::size_t{1024 * 1024};
+
+constexpr auto MIN_CHUNK_SIZE = std::size_t{4 * 1024};
+constexpr auto MAX_CHUNK_SIZE = std::size_t{256 * 1024};
+
+}
+
+
+StreamReader::StreamReader(
+  const int fd,
+  const std::optional<Clock::duration> inlineReadBudget,
+  std::function<void()> onDataAvailable)
+  : mInlineReadBudget(inlineReadBudget)
+  , mBuffer(inlineReadBudget ? 1 : BUFFER_SIZE)
+  , mOnDataAvailable(std::move(onDataAvailable))
+  , mFd(fd)
+  , mStopEventFd(-1)
+{
+  if (mInlineReadBudget)
+  {
+    mChunk.resize(MIN_CHUNK_SIZE);
+    return;
+  }
+
+  mStopEventFd = eventfd(0, EFD_CLOEXEC);
+  if (mStopEventFd == -1)
+  {
+    throw std::runtime_error("Failed to create eventfd");
+  }
+
+  mThread = std::thread([this]() { readLoop(); });
+}
+
+
+StreamReader::~StreamReader()
+{
+  if (!mThread.joinable())
+  {
+    return;
+  }
+
+  // Wake up the reader thread in case it's waiting for data, or for the
+  // UI thread to catch up.
+  const std::uint64_t value = 1;
+  write(mStopEventFd, &value, sizeof(value));
+  mBuffer.stopWaiting();
+
+  mThread.join();
+  close(mStopEventFd);
+}
+
+
+bool StreamReader::isFinished() const
+{
+  return mFinished.load(std::memory_order_acquire);
+}
+
+
+bool StreamReader::hasFailed() const
+{
+  return mFailed.load(std::memory_order_acquire);
+}
+
+
+std::size_t StreamReader::readChunk()
+{
+  if (isFinished())
+  {
+    return 0;
+  }
+
+  for (;;)
+  {
+    // We must never block the UI thread when reading. The descriptor's
+    // O_NONBLOCK flag would be shared with other processes using the same
+    // pipe or terminal, like the shell we were started from. So instead,
+    // only read once poll() says that won't block.
+    struct pollfd pollData = {mFd, POLLIN, 0};
+    const auto result = poll(&pollData, 1, 0);
+    if (result == 0)
+    {
+      return 0;
+    }
+
+    if (result < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      mFailed.store(true, std::memory_order_release);
+      mFinished.store(true, std::memory_order_release);
+      return 0;
+    }
+
+    const auto bytesRead = read(mFd, mChunk.data(), mChunk.size());
+    if (bytesRead > 0)
+    {
+      return bytesRead;
+    }
+
+    if (bytesRead == 0)
+    {
+      mFinished.store(true, std::memory_order_release);
+      return 0;
+    }
+
+    if (errno == EINTR)
+    {
+      continue;
+    }
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      mFailed.store(true, std::memory_order_release);
+      mFinished.store(true, std::memory_order_release);
+    }
+
+    return 0;
+  }
+}
+
+
+void StreamReader::growChunk()
+{
+  // We filled the whole chunk, so there's likely more data waiting.
+  // Use bigger reads to get through it with fewer syscalls. The chunk's
+  // contents have been consumed already, so don't bother keeping them.
+  if (mChunk.size() < MAX_CHUNK_SIZE)
+  {
+    std::vector<char>(mChunk.size() * 2).swap(mChunk);
+  }
+}
+
+
+void StreamReader::adaptChunkSize(const std::size_t bytesReadThisFrame)
+{
+  // Give memory back once the output has calmed down again.
+  if (bytesReadThisFrame < mChunk.size() / 4 && mChunk.size() > MIN_CHUNK_SIZE)
+  {
+    mChunk.resize(mChunk.size() / 2);
+    mChunk.shrink_to_fit();
+  }
+}
+
+
+void StreamReader::readLoop()
+{
+  for (;;)
+  {
+    struct pollfd pollData[] = {
+      {mFd, POLLIN, 0},
+      {mStopEventFd, POLLIN, 0}
+    };
+
+    // If the UI thread hasn't caught up yet, there's no point in reading.
+    // Still no space after waiting means we were asked to stop.
+    const auto [pFree, freeSize] = mBuffer.writable();
+    if (freeSize == 0)
+    {
+      mBuffer.waitForSpace();
+      if (mBuffer.writable().second == 0)
+      {
+        break;
+      }
+
+      continue;
+    }
+
+    const auto result = poll(pollData, 2, -1);
+
+    if (result < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      mFailed.store(true, std::memory_order_release);
+      break;
+    }
+
+    if (pollData[1].revents)
+    {
+      break;
+    }
+
+    if (!pollData[0].revents)
+    {
+      continue;
+    }
+
+    // POLLHUP and POLLERR are handled by read() returning 0 or -1, after
+    // any remaining data has been read.
+    const auto bytesRead = read(mFd, pFree, freeSize);
+    if (bytesRead > 0)
+    {
+      mBuffer.commitWrite(bytesRead);
+      notify();
+    }
+    else if (bytesRead == 0)
+    {
+      break;
+    }
+    else if (errno != EINTR && errno != EAGAIN)
+    {
+      mFailed.store(true, std::memory_order_release);
+      break;
+    }
+  }
+
+  mFinished.store(true, std::memory_order_release);
+
+  // Let the UI thread know that we're done, so it doesn't need to poll for
+  // that either.
+  mNotificationPending.store(false);
+  notify();
+}
+
+
+void StreamReader::notify()
+{
+  if (mOnDataAvailable && !mNotificationPending.exchange(true))
+  {
+    mOnDataAvailable();
+  }
+}
@@ -0,0 +1,158 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "byte_ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
+
+
+/** Reads from a file descriptor on a background thread.
+  *
+  * Data is read in large chunks directly into a ring buffer, from which
+  * the UI thread picks it up once per frame. This decouples the rate at
+  * which we can consume a script's output from the frame rate.
+  *
+  * The reader thread can notify the UI thread when new data arrives, so
+  * that it doesn't need to poll. Notifications are coalesced until the
+  * next call to consume().
+  *
+  * Alternatively, when given a time budget, no thread is used. Instead,
+  * consume() reads from the file descriptor while poll() reports data,
+  * until there's no more or the budget is used up. The descriptor's flags
+  * are left alone, since they are shared with other processes.
+  *
+  * The file descriptor is not owned by the reader.
+  */
+class StreamReader {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit StreamReader(
+    int fd,
+    std::optional<Clock::duration> inlineReadBudget = std::nullopt,
+    std::function<void()> onDataAvailable = {});
+  ~StreamReader();
+
+  StreamReader(const StreamReader&) = delete;
+  StreamReader& operator=(const StreamReader&) = delete;
+
+  /** Hand all data that arrived so far to the given function.
+    *
+    * The function is called with (const char* pData, std::size_t size),
+    * possibly more than once. Returns the total number of bytes consumed.
+    */
+  template <typename Callback>
+  std::size_t consume(Callback&& callback)
+  {
+    if (mInlineReadBudget)
+    {
+      return consumeInline(callback);
+    }
+
+    // Clear this before looking at the buffer, so that anything written
+    // after we're done leads to another notification.
+    mNotificationPending.store(false);
+
+    std::size_t totalSize = 0;
+
+    for (;;)
+    {
+      const auto [pData, size] = mBuffer.readable();
+      if (size == 0)
+      {
+        break;
+      }
+
+      callback(pData, size);
+      mBuffer.commitRead(size);
+      totalSize += size;
+    }
+
+    return totalSize;
+  }
+
+  /** True once the end of the stream was reached, or reading failed.
+    *
+    * All data read up to that point can still be consume()d afterwards.
+    */
+  bool isFinished() const;
+
+  bool hasFailed() const;
+
+  /** True if data arrival is only noticed by calling consume(), without
+    * any notification.
+    */
+  bool needsPolling() const { return mInlineReadBudget.has_value(); }
+
+private:
+  template <typename Callback>
+  std::size_t consumeInline(Callback& callback)
+  {
+    const auto deadline = Clock::now() + *mInlineReadBudget;
+
+    std::size_t totalSize = 0;
+    do
+    {
+      const auto size = readChunk();
+      if (size == 0)
+      {
+        break;
+      }
+
+      callback(mChunk.data(), size);
+      totalSize += size;
+
+      if (size == mChunk.size())
+      {
+        growChunk();
+      }
+    }
+    while (Clock::now() < deadline);
+
+    adaptChunkSize(totalSize);
+    return totalSize;
+  }
+
+  std::size_t readChunk();
+  void growChunk();
+  void adaptChunkSize(std::size_t bytesReadThisFrame);
+  void readLoop();
+  void notify();
+
+  std::optional<Clock::duration> mInlineReadBudget;
+  std::vector<char> mChunk;
+  ByteRing mBuffer;
+  std::atomic<bool> mFinished{false};
+  std::atomic<bool> mFailed{false};
+  std::atomic<bool> mNotificationPending{false};
+  std::function<void()> mOnDataAvailable;
+  int mFd;
+  int mStopEventFd;
+  std::thread mThread;
+};
@@ -0,0 +1,76 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "style_spans.hpp"
+
+#include <limits>
+
+
+void StyleSpans::append(
+  std::uint64_t offset,
+  std::size_t length,
+  const StyleId style)
+{
+  if (length == 0 || style == 0)
+  {
+    return;
+  }
+
+  // Continue the previous span if possible, so that a long run of text in
+  // the same style only needs a single span.
+  if (!mSpans.empty())
+  {
+    auto& last = mSpans.back();
+    if (
+      last.mStyle == style &&
+      last.mOffset + last.mLength == offset &&
+      last.mLength + length <= std::numeric_limits<std::uint32_t>::max())
+    {
+      last.mLength += static_cast<std::uint32_t>(length);
+      return;
+    }
+  }
+
+  while (length > 0)
+  {
+    const auto spanLength = static_cast<std::uint32_t>(std::min<std::size_t>(
+      length, std::numeric_limits<std::uint32_t>::max()));
+    mSpans.push_back({offset, spanLength, style});
+    offset += spanLength;
+    length -= spanLength;
+  }
+}
+
+
+void StyleSpans::discardBefore(const std::uint64_t offset)
+{
+  while (!mSpans.empty() && mSpans.front().mOffset + mSpans.front().mLength <= offset)
+  {
+    mSpans.pop_front();
+  }
+
+  if (!mSpans.empty() && mSpans.front().mOffset < offset)
+  {
+    auto& first = mSpans.front();
+    first.mLength -= static_cast<std::uint32_t>(offset - first.mOffset);
+    first.mOffset = offset;
+  }
+}
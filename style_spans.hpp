@@ -0,0 +1,95 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+
+/** Identifies how a piece of text is drawn. 0 is the default style. */
+using StyleId = std::uint16_t;
+
+
+/** Ranges of text which are drawn in a style other than the default one.
+  *
+  * Spans refer to text by offset, like the line index, and are kept next to
+  * it instead of splitting the text into per-line strings. Text without any
+  * special styling doesn't need any spans at all. Spans are appended in
+  * order and can be dropped from the front along with the text they refer
+  * to.
+  */
+class StyleSpans {
+public:
+  /** Mark length bytes starting at offset as being drawn in the given
+    * style. The offset must not be before the end of the last span.
+    */
+  void append(std::uint64_t offset, std::size_t length, StyleId style);
+
+  /** Drop spans (or parts of them) before the given offset. */
+  void discardBefore(std::uint64_t offset);
+
+  void clear() { mSpans.clear(); }
+
+  bool empty() const { return mSpans.empty(); }
+
+  /** Call f(spanBegin, spanEnd, style) for each span overlapping the given
+    * range, clipped to the range.
+    */
+  template <typename F>
+  void forEachSpan(const std::uint64_t begin, const std::uint64_t end, F&& f) const
+  {
+    // Find the last span starting before the range, which might still
+    // extend into it.
+    auto iSpan = std::upper_bound(
+      mSpans.begin(),
+      mSpans.end(),
+      begin,
+      [](const std::uint64_t offset, const Span& span) {
+        return offset < span.mOffset;
+      });
+    if (iSpan != mSpans.begin())
+    {
+      --iSpan;
+    }
+
+    for (; iSpan != mSpans.end() && iSpan->mOffset < end; ++iSpan)
+    {
+      const auto spanBegin = std::max(iSpan->mOffset, begin);
+      const auto spanEnd = std::min(iSpan->mOffset + iSpan->mLength, end);
+      if (spanBegin < spanEnd)
+      {
+        f(spanBegin, spanEnd, iSpan->mStyle);
+      }
+    }
+  }
+
+private:
+  struct Span {
+    std::uint64_t mOffset;
+    std::uint32_t mLength;
+    StyleId mStyle;
+  };
+
+  std::deque<Span> mSpans;
+};
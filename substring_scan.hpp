@@ -0,0 +1,138 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+/** Call func(const char* pMatch) for each occurrence of the needle in
+  * [pBegin, pEnd), in order. Overlapping occurrences are all reported.
+  *
+  * With SSE2 or NEON, 16 candidate positions are checked at a time by
+  * comparing against the needle's first and last byte. Only positions
+  * where both match are compared in full, which rules out almost all
+  * others for text of any kind.
+  */
+template <typename Func>
+void forEachMatch(
+  const char* pBegin,
+  const char* pEnd,
+  const char* pNeedle,
+  const std::size_t needleSize,
+  Func&& func)
+{
+  if (needleSize == 0 || std::size_t(pEnd - pBegin) < needleSize)
+  {
+    return;
+  }
+
+  // Last position where a match can start
+  const auto pLast = pEnd - needleSize;
+  const auto firstByte = pNeedle[0];
+  const auto lastByte = pNeedle[needleSize - 1];
+
+  auto matchesInner = [&](const char* pCandidate)
+  {
+    return needleSize <= 2 ||
+      std::memcmp(pCandidate + 1, pNeedle + 1, needleSize - 2) == 0;
+  };
+
+  auto p = pBegin;
+
+#if defined(__SSE2__)
+  const auto firstBytes = _mm_set1_epi8(firstByte);
+  const auto lastBytes = _mm_set1_epi8(lastByte);
+  for (; pLast - p >= 15; p += 16)
+  {
+    const auto blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const auto blockLast = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(p + needleSize - 1));
+    auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(
+      _mm_cmpeq_epi8(blockFirst, firstBytes),
+      _mm_cmpeq_epi8(blockLast, lastBytes))));
+
+    while (mask)
+    {
+      const auto pCandidate = p + __builtin_ctz(mask);
+      if (matchesInner(pCandidate))
+      {
+        func(pCandidate);
+      }
+
+      mask &= mask - 1;
+    }
+  }
+#elif defined(__ARM_NEON)
+  const auto firstBytes = vdupq_n_u8(static_cast<std::uint8_t>(firstByte));
+  const auto lastBytes = vdupq_n_u8(static_cast<std::uint8_t>(lastByte));
+  for (; pLast - p >= 15; p += 16)
+  {
+    const auto blockFirst = vld1q_u8(reinterpret_cast<const std::uint8_t*>(p));
+    const auto blockLast = vld1q_u8(
+      reinterpret_cast<const std::uint8_t*>(p + needleSize - 1));
+    const auto candidates = vandq_u8(
+      vceqq_u8(blockFirst, firstBytes),
+      vceqq_u8(blockLast, lastBytes));
+
+    // Same trick as in forEachNewline(), 4 bits per input byte.
+    auto mask = vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(candidates), 4)), 0);
+
+    while (mask)
+    {
+      const auto bit = __builtin_ctzll(mask);
+      const auto pCandidate = p + (bit >> 2);
+      if (matchesInner(pCandidate))
+      {
+        func(pCandidate);
+      }
+
+      mask &= ~(std::uint64_t{0xF} << (bit & ~3));
+    }
+  }
+#endif
+
+  while (p <= pLast)
+  {
+    const auto pCandidate = static_cast<const char*>(
+      std::memchr(p, firstByte, pLast - p + 1));
+    if (!pCandidate)
+    {
+      break;
+    }
+
+    if (pCandidate[needleSize - 1] == lastByte && matchesInner(pCandidate))
+    {
+      func(pCandidate);
+    }
+
+    p = pCandidate + 1;
+  }
+}
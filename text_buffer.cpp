@@ -0,0 +1,677 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "text_buffer.hpp"
+
+#include "unique_fd.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+
+namespace
+{
+
+constexpr auto ARENA_GRANULARITY = std::size_t{64 * 1024};
+
+// Files mapped a window at a time use windows of this size, starting at
+// multiples of half of it. So any range of up to half a window fits into
+// a single one.
+constexpr auto WINDOW_SIZE = std::uint64_t{4 * 1024 * 1024};
+
+// Limit on mapped windows if none was given, for files which are too large
+// to be mapped as a whole
+constexpr auto DEFAULT_MAX_MAPPED_SIZE = std::size_t{64 * 1024 * 1024};
+
+// Files larger than this are always mapped a window at a time. Where
+// address space is only 32 bits, a mapping this large would rarely find
+// enough of it in one piece.
+constexpr auto MAX_WHOLE_MAPPING_SIZE = std::numeric_limits<std::size_t>::max() / 4;
+
+// Mapped text is copied in pieces of this size when it's appended to.
+constexpr auto COPY_CHUNK_SIZE = std::uint64_t{1024 * 1024};
+
+
+/** One mapped part of a file */
+struct Window {
+  ~Window()
+  {
+    munmap(const_cast<char*>(pMapping), size);
+  }
+
+  Window(const Window&) = delete;
+  Window& operator=(const Window&) = delete;
+
+  const char* pMapping;
+  std::uint64_t offset;
+  std::size_t size;
+};
+
+std::string readAll(const int fd)
+{
+  std::string text;
+
+  char bytes[4096];
+  for (;;)
+  {
+    const auto bytesRead = read(fd, bytes, sizeof(bytes));
+    if (bytesRead == -1)
+    {
+      throw std::runtime_error("Error read()-ing input file");
+    }
+
+    if (bytesRead == 0)
+    {
+      break;
+    }
+
+    text.append(bytes, bytesRead);
+  }
+
+  return text;
+}
+
+}
+
+
+struct TextBuffer::MappedFile {
+  UniqueFd fd;
+  std::size_t maxMappedSize = 0;
+
+  // Guards the windows. The most recently used one is in front.
+  std::mutex mutex;
+  std::list<std::shared_ptr<const Window>> windows;
+  std::size_t mappedSize = 0;
+};
+
+
+TextBuffer::TextBuffer() = default;
+
+
+TextBuffer::TextBuffer(std::string text)
+{
+  append(text.data(), text.size());
+}
+
+
+TextBuffer::~TextBuffer()
+{
+  unmap();
+  freeArena();
+  freeRing();
+}
+
+
+TextBuffer::TextBuffer(TextBuffer&& other) noexcept
+  : mpArena(std::exchange(other.mpArena, nullptr))
+  , mArenaCapacity(std::exchange(other.mArenaCapacity, 0))
+  , mpRing(std::exchange(other.mpRing, nullptr))
+  , mRingCapacity(std::exchange(other.mRingCapacity, 0))
+  , mSizeLimit(std::exchange(other.mSizeLimit, 0))
+  , mpMapping(std::exchange(other.mpMapping, nullptr))
+  , mpMappedFile(std::move(other.mpMappedFile))
+  , mStartOffset(std::exchange(other.mStartOffset, 0))
+  , mEndOffset(std::exchange(other.mEndOffset, 0))
+{
+}
+
+
+TextBuffer& TextBuffer::operator=(TextBuffer&& other) noexcept
+{
+  if (this != &other)
+  {
+    unmap();
+    freeArena();
+    freeRing();
+    mpArena = std::exchange(other.mpArena, nullptr);
+    mArenaCapacity = std::exchange(other.mArenaCapacity, 0);
+    mpRing = std::exchange(other.mpRing, nullptr);
+    mRingCapacity = std::exchange(other.mRingCapacity, 0);
+    mSizeLimit = std::exchange(other.mSizeLimit, 0);
+    mpMapping = std::exchange(other.mpMapping, nullptr);
+    mpMappedFile = std::move(other.mpMappedFile);
+    mStartOffset = std::exchange(other.mStartOffset, 0);
+    mEndOffset = std::exchange(other.mEndOffset, 0);
+  }
+
+  return *this;
+}
+
+
+TextBuffer TextBuffer::mapFile(const std::string& path, const std::size_t maxMappedSize)
+{
+  const auto fd = UniqueFd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (!fd)
+  {
+    throw std::runtime_error("Failed to open input file");
+  }
+
+  return mapFile(fd.get(), maxMappedSize);
+}
+
+
+TextBuffer TextBuffer::mapFile(const int fd, const std::size_t maxMappedSize)
+{
+  struct stat fileInfo;
+  if (fstat(fd, &fileInfo) == -1)
+  {
+    throw std::runtime_error("Failed to stat input file");
+  }
+
+  TextBuffer buffer;
+
+  // Pipes and files in /proc etc. don't have a meaningful size, and can't be
+  // mapped. Fall back to reading them in one go.
+  if (!S_ISREG(fileInfo.st_mode))
+  {
+    const auto text = readAll(fd);
+    buffer.append(text.data(), text.size());
+    return buffer;
+  }
+
+  // Mapping an empty file is an error, but there's nothing to map anyway.
+  const auto size = std::uint64_t(fileInfo.st_size);
+  if (size == 0)
+  {
+    return buffer;
+  }
+
+  if (size <= MAX_WHOLE_MAPPING_SIZE && (maxMappedSize == 0 || size <= maxMappedSize))
+  {
+    const auto pMapping = mmap(nullptr, std::size_t(size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pMapping != MAP_FAILED)
+    {
+      // Text is mostly read front to back, so aggressive read-ahead pays
+      // off. This is only a hint, failure is not an error.
+      madvise(pMapping, std::size_t(size), MADV_SEQUENTIAL);
+
+      // The mapping stays valid after closing the file descriptor.
+      buffer.mpMapping = static_cast<const char*>(pMapping);
+      buffer.mEndOffset = size;
+      return buffer;
+    }
+
+    // Without enough address space, windows might still fit.
+    if (errno != ENOMEM)
+    {
+      throw std::runtime_error("Failed to mmap() input file");
+    }
+  }
+
+  // Windows are mapped later on, so this needs a descriptor of its own.
+  auto pMappedFile = std::make_unique<MappedFile>();
+  pMappedFile->fd = UniqueFd{fcntl(fd, F_DUPFD_CLOEXEC, 0)};
+  if (!pMappedFile->fd)
+  {
+    throw std::runtime_error("Failed to dup() input file");
+  }
+
+  pMappedFile->maxMappedSize = maxMappedSize > 0 ? maxMappedSize : DEFAULT_MAX_MAPPED_SIZE;
+  buffer.mpMappedFile = std::move(pMappedFile);
+  buffer.mEndOffset = size;
+  return buffer;
+}
+
+
+bool TextBuffer::extendMapping(const int fd, const std::size_t maxMappedSize)
+{
+  if (mpArena || mpRing)
+  {
+    return false;
+  }
+
+  struct stat fileInfo;
+  if (fstat(fd, &fileInfo) == -1 || !S_ISREG(fileInfo.st_mode))
+  {
+    return false;
+  }
+
+  // A truncated file has to be mapped again from the start, by the caller.
+  const auto size = std::uint64_t(fileInfo.st_size);
+  if (size <= mEndOffset)
+  {
+    return true;
+  }
+
+  if (mpMappedFile)
+  {
+    // Windows are only mapped when read, so they can cover the new text
+    // right away.
+    mEndOffset = size;
+  }
+  else
+  {
+    // Growing the mapping in place keeps the pages which were read already.
+    // If it has grown too large, or there isn't enough address space left,
+    // the file is mapped anew.
+    const auto pMapping = mpMapping &&
+      size <= MAX_WHOLE_MAPPING_SIZE &&
+      (maxMappedSize == 0 || size <= maxMappedSize)
+      ? mremap(const_cast<char*>(mpMapping), mEndOffset, std::size_t(size), MREMAP_MAYMOVE)
+      : MAP_FAILED;
+    if (pMapping != MAP_FAILED)
+    {
+      madvise(pMapping, std::size_t(size), MADV_SEQUENTIAL);
+      mpMapping = static_cast<const char*>(pMapping);
+      mEndOffset = size;
+    }
+    else
+    {
+      const auto startOffset = mStartOffset;
+      const auto sizeLimit = mSizeLimit;
+      try
+      {
+        *this = mapFile(fd, maxMappedSize);
+      }
+      catch (const std::exception&)
+      {
+        return false;
+      }
+
+      mStartOffset = std::min(startOffset, mEndOffset);
+      mSizeLimit = sizeLimit;
+    }
+  }
+
+  // Discarding mapped text only means not showing it anymore.
+  if (mSizeLimit > 0 && this->size() > mSizeLimit)
+  {
+    mStartOffset = mEndOffset - mSizeLimit;
+  }
+
+  return true;
+}
+
+
+TextBuffer::Range TextBuffer::range(const std::uint64_t begin, const std::uint64_t end) const
+{
+  if (mpMappedFile && begin < end)
+  {
+    return mappedRange(begin, end);
+  }
+
+  Range range;
+  range.mpData = at(begin);
+  range.mSize = std::size_t(end - begin);
+  return range;
+}
+
+
+const char* TextBuffer::at(const std::uint64_t offset) const
+{
+  if (mpRing)
+  {
+    return mpRing + offset % mRingCapacity;
+  }
+
+  if (mpMapping)
+  {
+    return mpMapping + offset;
+  }
+
+  return mpArena ? mpArena + offset : "";
+}
+
+
+TextBuffer::Range TextBuffer::mappedRange(
+  const std::uint64_t begin,
+  const std::uint64_t end) const
+{
+  auto& file = *mpMappedFile;
+  std::lock_guard<std::mutex> lock(file.mutex);
+
+  const auto iWindow = std::find_if(
+    file.windows.begin(),
+    file.windows.end(),
+    [&](const std::shared_ptr<const Window>& pWindow)
+    {
+      return pWindow->offset <= begin && end <= pWindow->offset + pWindow->size;
+    });
+
+  if (iWindow != file.windows.end())
+  {
+    file.windows.splice(file.windows.begin(), file.windows, iWindow);
+  }
+  else
+  {
+    // Longer ranges than fit into a regular window get one of their own.
+    const auto pageSize = std::uint64_t(sysconf(_SC_PAGESIZE));
+    const auto windowStart = begin / (WINDOW_SIZE / 2) * (WINDOW_SIZE / 2);
+    const auto windowEnd = std::min(
+      mEndOffset,
+      std::max(windowStart + WINDOW_SIZE, (end + pageSize - 1) / pageSize * pageSize));
+    if (windowEnd - windowStart > std::numeric_limits<std::size_t>::max())
+    {
+      throw std::bad_alloc();
+    }
+
+    const auto windowSize = std::size_t(windowEnd - windowStart);
+    const auto pMapping = mmap(
+      nullptr, windowSize, PROT_READ, MAP_PRIVATE, file.fd.get(), off_t(windowStart));
+    if (pMapping == MAP_FAILED)
+    {
+      throw std::runtime_error("Failed to mmap() input file");
+    }
+
+    file.windows.push_front(std::shared_ptr<const Window>(
+      new Window{static_cast<const char*>(pMapping), windowStart, windowSize}));
+    file.mappedSize += windowSize;
+
+    // Windows which are still being read stay mapped until they're done.
+    while (file.mappedSize > file.maxMappedSize && file.windows.size() > 1)
+    {
+      file.mappedSize -= file.windows.back()->size;
+      file.windows.pop_back();
+    }
+  }
+
+  const auto& pWindow = file.windows.front();
+  Range range;
+  range.mpData = pWindow->pMapping + (begin - pWindow->offset);
+  range.mSize = std::size_t(end - begin);
+  range.mpWindow = pWindow;
+  return range;
+}
+
+
+void TextBuffer::prefetch(std::uint64_t begin, std::uint64_t end) const
+{
+  end = std::min(mEndOffset, end);
+  if (mpMappedFile && begin < end)
+  {
+    // Windows which aren't mapped yet can still be read into the page
+    // cache.
+    posix_fadvise(mpMappedFile->fd.get(), off_t(begin), off_t(end - begin), POSIX_FADV_WILLNEED);
+    return;
+  }
+
+  if (!mpMapping)
+  {
+    return;
+  }
+
+  // Round outwards to whole pages
+  const auto pageSize = std::uint64_t(sysconf(_SC_PAGESIZE));
+  begin = begin / pageSize * pageSize;
+  if (begin < end)
+  {
+    madvise(const_cast<char*>(mpMapping) + begin, end - begin, MADV_WILLNEED);
+  }
+}
+
+
+void TextBuffer::releasePages(std::uint64_t begin, std::uint64_t end) const
+{
+  // Round inwards to whole pages, so that nothing outside the range is
+  // affected. The mapping is read-only, so dropping pages never loses
+  // anything.
+  const auto pageSize = std::uint64_t(sysconf(_SC_PAGESIZE));
+  begin = (begin + pageSize - 1) / pageSize * pageSize;
+  end = std::min(mEndOffset, end) / pageSize * pageSize;
+
+  if (mpMappedFile)
+  {
+    // Windows start on page boundaries.
+    std::lock_guard<std::mutex> lock(mpMappedFile->mutex);
+    for (const auto& pWindow : mpMappedFile->windows)
+    {
+      const auto windowBegin = std::max(begin, pWindow->offset);
+      const auto windowEnd = std::min(end, pWindow->offset + pWindow->size);
+      if (windowBegin < windowEnd)
+      {
+        madvise(
+          const_cast<char*>(pWindow->pMapping) + (windowBegin - pWindow->offset),
+          std::size_t(windowEnd - windowBegin),
+          MADV_DONTNEED);
+      }
+    }
+
+    return;
+  }
+
+  if (mpMapping && begin < end)
+  {
+    madvise(const_cast<char*>(mpMapping) + begin, end - begin, MADV_DONTNEED);
+  }
+}
+
+
+void TextBuffer::setSizeLimit(const std::size_t maxSize)
+{
+  mSizeLimit = maxSize;
+}
+
+
+void TextBuffer::discardBefore(const std::uint64_t offset)
+{
+  if (mpRing || mpMapping || mpMappedFile)
+  {
+    mStartOffset = std::clamp(offset, mStartOffset, mEndOffset);
+  }
+}
+
+
+void TextBuffer::append(const char* pData, const std::size_t size)
+{
+  if (size == 0)
+  {
+    return;
+  }
+
+  // The mapping is read-only, so the mapped text is copied first. That's
+  // done piece by piece, in case it's mapped a window at a time.
+  if (mpMapping || mpMappedFile)
+  {
+    auto mapped = std::move(*this);
+    mSizeLimit = mapped.mSizeLimit;
+
+    // Text that doesn't fit is skipped, as in appendToRing().
+    auto offset = mapped.startOffset();
+    if (mSizeLimit > 0 && mapped.size() > mSizeLimit)
+    {
+      offset = mapped.endOffset() - mSizeLimit;
+      mStartOffset = offset;
+      mEndOffset = offset;
+    }
+
+    for (; offset < mapped.endOffset(); offset += COPY_CHUNK_SIZE)
+    {
+      const auto range = mapped.range(
+        offset, std::min(mapped.endOffset(), offset + COPY_CHUNK_SIZE));
+      append(range.data(), range.size());
+    }
+  }
+
+  if (mSizeLimit > 0)
+  {
+    appendToRing(pData, size);
+    return;
+  }
+
+  if (mEndOffset + size > mArenaCapacity)
+  {
+    reserve(std::max(mArenaCapacity * 2, std::size_t(mEndOffset) + size));
+  }
+
+  std::memcpy(mpArena + mEndOffset, pData, size);
+  mEndOffset += size;
+}
+
+
+void TextBuffer::appendToRing(const char* pData, std::size_t size)
+{
+  // Text that doesn't fit at all is skipped, as if it had been discarded.
+  if (size > mSizeLimit)
+  {
+    const auto skipped = size - mSizeLimit;
+    pData += skipped;
+    size = mSizeLimit;
+    mEndOffset += skipped;
+    mStartOffset = mEndOffset;
+  }
+
+  const auto requiredSize = std::size_t(this->size()) + size;
+  if (requiredSize > mRingCapacity && mRingCapacity < mSizeLimit)
+  {
+    reserveRing(std::min(
+      std::max(mRingCapacity * 2, requiredSize),
+      mSizeLimit));
+  }
+
+  if (requiredSize > mSizeLimit)
+  {
+    mStartOffset += requiredSize - mSizeLimit;
+  }
+
+  // Thanks to the second mapping, this never needs to be split in two.
+  std::memcpy(mpRing + mEndOffset % mRingCapacity, pData, size);
+  mEndOffset += size;
+}
+
+
+void TextBuffer::reserve(std::size_t capacity)
+{
+  capacity = (capacity + ARENA_GRANULARITY - 1) / ARENA_GRANULARITY * ARENA_GRANULARITY;
+
+  // Anonymous mappings are only backed by memory once touched, and
+  // mremap() can move them by just updating page tables.
+  const auto pArena = mpArena
+    ? mremap(mpArena, mArenaCapacity, capacity, MREMAP_MAYMOVE)
+    : mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pArena == MAP_FAILED)
+  {
+    throw std::bad_alloc();
+  }
+
+  mpArena = static_cast<char*>(pArena);
+  mArenaCapacity = capacity;
+}
+
+
+void TextBuffer::reserveRing(std::size_t capacity)
+{
+  // Both mappings need to start on a page boundary.
+  capacity = (capacity + ARENA_GRANULARITY - 1) / ARENA_GRANULARITY * ARENA_GRANULARITY;
+
+  const auto fd = memfd_create("TvTextViewer scrollback", MFD_CLOEXEC);
+  if (fd == -1)
+  {
+    throw std::bad_alloc();
+  }
+
+  if (ftruncate(fd, capacity) == -1)
+  {
+    close(fd);
+    throw std::bad_alloc();
+  }
+
+  // Reserve address space for both views first, then put the two mappings
+  // in place on top of it.
+  const auto pRegion = static_cast<char*>(mmap(
+    nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  const auto mapView = [&](char* pAddress)
+  {
+    return mmap(
+      pAddress,
+      capacity,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_FIXED,
+      fd,
+      0) != MAP_FAILED;
+  };
+
+  const auto mapped =
+    pRegion != MAP_FAILED && mapView(pRegion) && mapView(pRegion + capacity);
+  close(fd);
+
+  if (!mapped)
+  {
+    if (pRegion != MAP_FAILED)
+    {
+      munmap(pRegion, capacity * 2);
+    }
+
+    throw std::bad_alloc();
+  }
+
+  // Text shows up at different addresses in a ring of a different size.
+  if (size() > capacity)
+  {
+    mStartOffset = mEndOffset - capacity;
+  }
+
+  const auto pOldText = size() > 0 ? at(mStartOffset) : nullptr;
+  if (pOldText)
+  {
+    std::memcpy(pRegion + mStartOffset % capacity, pOldText, size());
+  }
+
+  freeRing();
+  freeArena();
+  mpRing = pRegion;
+  mRingCapacity = capacity;
+}
+
+
+void TextBuffer::unmap()
+{
+  if (mpMapping)
+  {
+    munmap(const_cast<char*>(mpMapping), mEndOffset);
+    mpMapping = nullptr;
+  }
+
+  mpMappedFile.reset();
+}
+
+
+void TextBuffer::freeArena()
+{
+  if (mpArena)
+  {
+    munmap(mpArena, mArenaCapacity);
+    mpArena = nullptr;
+    mArenaCapacity = 0;
+  }
+}
+
+
+void TextBuffer::freeRing()
+{
+  if (mpRing)
+  {
+    munmap(mpRing, mRingCapacity * 2);
+    mpRing = nullptr;
+    mRingCapacity = 0;
+  }
+}
@@ -0,0 +1,171 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+
+/** Storage for the text shown by the viewer.
+  *
+  * Either owns its contents (messages, script output), or refers to a
+  * read-only memory mapping of a file. The latter makes opening a file
+  * independent of its size, since pages are only read in once they are
+  * actually accessed.
+  *
+  * A file can also be mapped a window at a time, when it's too large for
+  * the address space, or to bound the memory its mapping occupies. Only
+  * the most recently used windows stay mapped. That's why text is read
+  * through range(), which keeps the part being read mapped.
+  *
+  * Owned text lives in an anonymous memory mapping which is grown with
+  * mremap(), so appending never copies the text that's already there.
+  *
+  * With a size limit, owned text is kept in a ring buffer instead, and the
+  * oldest text is discarded to make room for new text. The ring's memory is
+  * mapped twice in a row, so that any part of the text is contiguous in
+  * memory even when it wraps around the end. Text is addressed by offsets
+  * counting all bytes ever appended, which stay valid while older text is
+  * discarded.
+  */
+class TextBuffer {
+public:
+  TextBuffer();
+  explicit TextBuffer(std::string text);
+  ~TextBuffer();
+
+  TextBuffer(TextBuffer&& other) noexcept;
+  TextBuffer& operator=(TextBuffer&& other) noexcept;
+
+  TextBuffer(const TextBuffer&) = delete;
+  TextBuffer& operator=(const TextBuffer&) = delete;
+
+  /** Contiguous part of the text, which stays mapped while this exists. */
+  class Range {
+  public:
+    const char* data() const { return mpData; }
+    std::size_t size() const { return mSize; }
+
+  private:
+    friend class TextBuffer;
+
+    const char* mpData = "";
+    std::size_t mSize = 0;
+    std::shared_ptr<const void> mpWindow;
+  };
+
+  /** Map the given file into memory. Throws on failure.
+    *
+    * A file larger than maxMappedSize (if non-zero), or than can be mapped
+    * as a whole, is mapped a window at a time. At most about maxMappedSize
+    * of it is then mapped at once, plus the ranges currently being read.
+    */
+  static TextBuffer mapFile(const std::string& path, std::size_t maxMappedSize = 0);
+
+  /** Map an already open file. The descriptor stays owned by the caller. */
+  static TextBuffer mapFile(int fd, std::size_t maxMappedSize = 0);
+
+  /** Extend the mapped text over whatever was appended to the file since,
+    * without copying anything. Switches to mapping windows once the file
+    * has outgrown maxMappedSize. An empty buffer maps the file.
+    *
+    * The file must be the one that's mapped already. Returns false if the
+    * text can't be mapped, because it's owned or mapping failed. It then
+    * needs to be append()ed instead.
+    */
+  bool extendMapping(int fd, std::size_t maxMappedSize = 0);
+
+  /** Size of the text which is still retained */
+  std::uint64_t size() const { return mEndOffset - mStartOffset; }
+  bool empty() const { return size() == 0; }
+
+  /** Offset of the first retained byte. Only non-zero with a size limit. */
+  std::uint64_t startOffset() const { return mStartOffset; }
+  std::uint64_t endOffset() const { return mEndOffset; }
+
+  /** The text between the given offsets, which must be between
+    * startOffset() and endOffset().
+    *
+    * Cheap, unless the file is mapped a window at a time and the range
+    * isn't mapped currently. Can be called from several threads at once,
+    * as long as the text isn't modified. Throws if the range can't be
+    * mapped.
+    */
+  Range range(std::uint64_t begin, std::uint64_t end) const;
+
+  /** Hint that the given range will be accessed soon, so that it can be
+    * read from disk in advance. Only has an effect for mapped files.
+    */
+  void prefetch(std::uint64_t begin, std::uint64_t end) const;
+
+  /** Hint that the given range won't be accessed for a while, so that the
+    * memory it occupies can be reclaimed. It's read from disk again when
+    * needed. Only has an effect for mapped files.
+    */
+  void releasePages(std::uint64_t begin, std::uint64_t end) const;
+
+  /** Keep at most maxSize bytes of text, discarding the oldest text when
+    * appending more. Takes effect on the next append() or extendMapping().
+    */
+  void setSizeLimit(std::size_t maxSize);
+
+  /** Drop text before the given offset. Only possible with a size limit,
+    * or for mapped text, otherwise this does nothing.
+    */
+  void discardBefore(std::uint64_t offset);
+
+  /** Append to the buffer.
+    *
+    * A mapped buffer is converted into an owned one first, as the mapping
+    * itself is read-only.
+    */
+  void append(const char* pData, std::size_t size);
+
+private:
+  struct MappedFile;
+
+  const char* at(std::uint64_t offset) const;
+  Range mappedRange(std::uint64_t begin, std::uint64_t end) const;
+  void appendToRing(const char* pData, std::size_t size);
+  void reserve(std::size_t capacity);
+  void reserveRing(std::size_t capacity);
+  void unmap();
+  void freeArena();
+  void freeRing();
+
+  char* mpArena = nullptr;
+  std::size_t mArenaCapacity = 0;
+
+  char* mpRing = nullptr;
+  std::size_t mRingCapacity = 0;
+  std::size_t mSizeLimit = 0;
+
+  const char* mpMapping = nullptr;
+
+  // Only set when the file is mapped a window at a time
+  std::unique_ptr<MappedFile> mpMappedFile;
+
+  std::uint64_t mStartOffset = 0;
+  std::uint64_t mEndOffset = 0;
+};
@@ -0,0 +1,144 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+#include "text_decoder.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace
+{
+
+// Converted text is handed on in pieces of at most this size.
+constexpr auto OUTPUT_BUFFER_SIZE = std::size_t{64 * 1024};
+
+}
+
+
+TextDecoder::TextDecoder(const std::string& encoding)
+{
+  if (!encoding.empty())
+  {
+    mConverter = iconv_open("UTF-8", encoding.c_str());
+    if (mConverter == iconv_t(-1))
+    {
+      throw std::runtime_error("Unsupported encoding: " + encoding);
+    }
+  }
+}
+
+
+TextDecoder::~TextDecoder()
+{
+  if (mConverter != iconv_t(-1))
+  {
+    iconv_close(mConverter);
+  }
+}
+
+
+void TextDecoder::reset()
+{
+  if (mConverter != iconv_t(-1))
+  {
+    iconv(mConverter, nullptr, nullptr, nullptr, nullptr);
+  }
+
+  mPendingInput.clear();
+  mJoinedInput.clear();
+  mpInput = nullptr;
+  mInputLeft = 0;
+}
+
+
+void TextDecoder::startInput(const char* pData, const std::size_t size)
+{
+  // The rest of a character that was cut off comes first. That only
+  // happens at the end of a chunk, so it's rare enough to copy the chunk.
+  if (!mPendingInput.empty())
+  {
+    mJoinedInput = std::move(mPendingInput);
+    mPendingInput.clear();
+    mJoinedInput.append(pData, size);
+    mpInput = mJoinedInput.data();
+    mInputLeft = mJoinedInput.size();
+    return;
+  }
+
+  mpInput = const_cast<char*>(pData);
+  mInputLeft = size;
+}
+
+
+bool TextDecoder::convertNext()
+{
+  mOutput.resize(OUTPUT_BUFFER_SIZE);
+  mOutputSize = 0;
+
+  while (mInputLeft > 0)
+  {
+    auto pOutput = mOutput.data() + mOutputSize;
+    auto outputLeft = mOutput.size() - mOutputSize;
+    const auto result = iconv(mConverter, &mpInput, &mInputLeft, &pOutput, &outputLeft);
+    mOutputSize = std::size_t(pOutput - mOutput.data());
+
+    if (result != std::size_t(-1))
+    {
+      break;
+    }
+
+    if (errno == EINVAL)
+    {
+      // The input ends in the middle of a character. Keep that part for
+      // the next chunk.
+      mPendingInput = std::string(mpInput, mInputLeft);
+      mInputLeft = 0;
+      return mOutputSize > 0;
+    }
+
+    if (errno == E2BIG)
+    {
+      // The output buffer is full, the rest is converted next time.
+      return true;
+    }
+
+    if (errno != EILSEQ)
+    {
+      throw std::runtime_error("Error converting text with iconv()");
+    }
+
+    // Not valid in the encoding. Skip a byte and go on from there.
+    if (mOutput.size() - mOutputSize < 3)
+    {
+      return true;
+    }
+
+    ++mpInput;
+    --mInputLeft;
+    std::memcpy(mOutput.data() + mOutputSize, REPLACEMENT, 3);
+    mOutputSize += 3;
+  }
+
+  return mOutputSize > 0;
+}
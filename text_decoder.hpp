@@ -0,0 +1,104 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+#pragma once
+
+#include <iconv.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+/** Converts incoming text from another encoding to UTF-8 with iconv.
+  *
+  * Text can arrive in chunks of any size, and is converted piece by piece
+  * into a buffer of fixed size, so that memory use doesn't depend on the
+  * size of the chunks. Without an encoding, the text is assumed to be UTF-8
+  * already, and handed on as is (invalid UTF-8 is dealt with separately,
+  * see Utf8Sanitizer).
+  */
+class TextDecoder {
+public:
+  /** Throws if iconv doesn't support the encoding. */
+  explicit TextDecoder(const std::string& encoding = {});
+  ~TextDecoder();
+
+  TextDecoder(const TextDecoder&) = delete;
+  TextDecoder& operator=(const TextDecoder&) = delete;
+
+  /** Call emit(const char* pBegin, const char* pEnd) for consecutive parts
+    * of the decoded text.
+    */
+  template <typename Func>
+  void decode(const char* pData, const std::size_t size, Func&& emit)
+  {
+    if (!isConverting())
+    {
+      emit(pData, pData + size);
+      return;
+    }
+
+    startInput(pData, size);
+    while (convertNext())
+    {
+      emit(mOutput.data(), mOutput.data() + mOutputSize);
+    }
+  }
+
+  /** The text has ended. An incomplete character that's still pending is
+    * replaced.
+    */
+  template <typename Func>
+  void finish(Func&& emit)
+  {
+    if (!mPendingInput.empty())
+    {
+      mPendingInput.clear();
+      emit(REPLACEMENT, REPLACEMENT + 3);
+    }
+  }
+
+  /** True if text is converted from another encoding. */
+  bool isConverting() const { return mConverter != iconv_t(-1); }
+
+  /** Start over with a new stream of text. */
+  void reset();
+
+private:
+  static constexpr const char* REPLACEMENT = "\xEF\xBF\xBD";
+
+  void startInput(const char* pData, std::size_t size);
+  bool convertNext();
+
+  iconv_t mConverter = iconv_t(-1);
+
+  // Input for convertNext(), and input cut off in the middle of a
+  // character, which is joined with the next chunk
+  char* mpInput = nullptr;
+  std::size_t mInputLeft = 0;
+  std::string mPendingInput;
+  std::string mJoinedInput;
+
+  std::vector<char> mOutput;
+  std::size_t mOutputSize = 0;
+};
@@ -0,0 +1,220 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "text_layer.hpp"
+
+#include "imgui_internal.h"
+
+#include <GLES2/gl2.h>
+
+#include <cstdint>
+
+
+namespace
+{
+
+// Without vertex offsets, which the GLES2 renderer doesn't support, 16-bit
+// indices can only address this many vertices.
+constexpr auto MAX_VERTICES =
+  sizeof(ImDrawIdx) == 2 ? std::size_t{1} << 16 : std::size_t{1} << 31;
+
+}
+
+
+TextLayer::TextLayer()
+  : mGeometry(nullptr)
+{
+}
+
+
+TextLayer::~TextLayer()
+{
+  releaseMemory();
+}
+
+
+void TextLayer::releaseMemory()
+{
+  mIsValid = false;
+  mGeometry._ClearFreeMemory();
+
+  if (mVertexBuffer)
+  {
+    glDeleteBuffers(1, &mVertexBuffer);
+    glDeleteBuffers(1, &mIndexBuffer);
+    mVertexBuffer = 0;
+    mIndexBuffer = 0;
+  }
+}
+
+
+ImDrawList& TextLayer::beginBuild(const std::size_t firstRow)
+{
+  mGeometry._Data = ImGui::GetDrawListSharedData();
+  mGeometry._ResetForNewFrame();
+  mGeometry.PushTextureID(ImGui::GetIO().Fonts->TexID);
+  mGeometry.PushClipRectFullScreen();
+
+  mFirstRow = firstRow;
+  mIsValid = false;
+  return mGeometry;
+}
+
+
+bool TextLayer::hasRoomFor(const std::size_t vertexCount) const
+{
+  return std::size_t(mGeometry.VtxBuffer.Size) + vertexCount <= MAX_VERTICES;
+}
+
+
+void TextLayer::endBuild(const std::size_t lastRow, const float width)
+{
+  mLastRow = lastRow;
+  mWidth = width;
+  mIsValid = true;
+  mNeedsUpload = true;
+}
+
+
+void TextLayer::draw(const ImVec2& position)
+{
+  // Same rounding as ImFont::RenderText(), so text stays sharp.
+  mTranslation = {IM_FLOOR(position.x), IM_FLOOR(position.y)};
+
+  const auto pDrawList = ImGui::GetWindowDrawList();
+  pDrawList->AddCallback(&TextLayer::render, this);
+  pDrawList->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+}
+
+
+void TextLayer::render(const ImDrawList*, const ImDrawCmd* pCommand)
+{
+  auto& self = *static_cast<TextLayer*>(pCommand->UserCallbackData);
+  self.upload();
+
+  // The renderer sets up the scissor rect for each regular draw command,
+  // but not for callbacks.
+  const auto pDrawData = ImGui::GetDrawData();
+  const auto& clipRect = pCommand->ClipRect;
+  const auto& displayPos = pDrawData->DisplayPos;
+  const auto& scale = pDrawData->FramebufferScale;
+  const auto framebufferHeight = pDrawData->DisplaySize.y * scale.y;
+  const auto x1 = (clipRect.x - displayPos.x) * scale.x;
+  const auto y1 = (clipRect.y - displayPos.y) * scale.y;
+  const auto x2 = (clipRect.z - displayPos.x) * scale.x;
+  const auto y2 = (clipRect.w - displayPos.y) * scale.y;
+  if (x2 <= x1 || y2 <= y1)
+  {
+    return;
+  }
+
+  glScissor(GLint(x1), GLint(framebufferHeight - y2), GLsizei(x2 - x1), GLsizei(y2 - y1));
+
+  // Use the renderer's shader, with the translation folded into its
+  // orthographic projection.
+  GLint program = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+  const auto left = displayPos.x - self.mTranslation.x;
+  const auto right = left + pDrawData->DisplaySize.x;
+  const auto top = displayPos.y - self.mTranslation.y;
+  const auto bottom = top + pDrawData->DisplaySize.y;
+  const float projection[4][4] = {
+    {2.0f / (right - left), 0.0f, 0.0f, 0.0f},
+    {0.0f, 2.0f / (top - bottom), 0.0f, 0.0f},
+    {0.0f, 0.0f, -1.0f, 0.0f},
+    {(right + left) / (left - right), (top + bottom) / (bottom - top), 0.0f, 1.0f},
+  };
+  glUniformMatrix4fv(
+    glGetUniformLocation(program, "ProjMtx"), 1, GL_FALSE, &projection[0][0]);
+
+  glBindTexture(
+    GL_TEXTURE_2D,
+    GLuint(reinterpret_cast<std::intptr_t>(ImGui::GetIO().Fonts->TexID)));
+  glBindBuffer(GL_ARRAY_BUFFER, self.mVertexBuffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, self.mIndexBuffer);
+
+  const auto setUpAttribute = [program](
+    const char* name,
+    const GLint size,
+    const GLenum type,
+    const GLboolean normalized,
+    const std::size_t offset)
+  {
+    const auto location = glGetAttribLocation(program, name);
+    if (location >= 0)
+    {
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(
+        location,
+        size,
+        type,
+        normalized,
+        sizeof(ImDrawVert),
+        reinterpret_cast<const void*>(offset));
+    }
+  };
+
+  setUpAttribute("Position", 2, GL_FLOAT, GL_FALSE, IM_OFFSETOF(ImDrawVert, pos));
+  setUpAttribute("UV", 2, GL_FLOAT, GL_FALSE, IM_OFFSETOF(ImDrawVert, uv));
+  setUpAttribute("Color", 4, GL_UNSIGNED_BYTE, GL_TRUE, IM_OFFSETOF(ImDrawVert, col));
+
+  for (const auto& command : self.mGeometry.CmdBuffer)
+  {
+    if (command.ElemCount > 0)
+    {
+      glDrawElements(
+        GL_TRIANGLES,
+        GLsizei(command.ElemCount),
+        sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+        reinterpret_cast<const void*>(command.IdxOffset * sizeof(ImDrawIdx)));
+    }
+  }
+}
+
+
+void TextLayer::upload()
+{
+  if (!mVertexBuffer)
+  {
+    glGenBuffers(1, &mVertexBuffer);
+    glGenBuffers(1, &mIndexBuffer);
+  }
+
+  if (!mNeedsUpload)
+  {
+    return;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+  glBufferData(
+    GL_ARRAY_BUFFER,
+    GLsizeiptr(mGeometry.VtxBuffer.Size) * sizeof(ImDrawVert),
+    mGeometry.VtxBuffer.Data,
+    GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+  glBufferData(
+    GL_ELEMENT_ARRAY_BUFFER,
+    GLsizeiptr(mGeometry.IdxBuffer.Size) * sizeof(ImDrawIdx),
+    mGeometry.IdxBuffer.Data,
+    GL_STATIC_DRAW);
+  mNeedsUpload = false;
+}
@@ -0,0 +1,103 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "imgui.h"
+
+#include <cstddef>
+
+
+/** Text geometry which is kept on the GPU across frames.
+  *
+  * ImGui normally generates vertices for all visible text each frame, and
+  * the renderer uploads them again. For text that doesn't change, that's
+  * wasted effort, and uploads are slow on some GPUs. Instead, the glyph
+  * quads for a range of rows around the visible ones are built once, and
+  * stay in a vertex buffer. Scrolling only changes the translation these
+  * are drawn with, and the geometry is only rebuilt once scrolling leaves
+  * the range, or the text changes.
+  *
+  * The layer is drawn via a draw list callback, in the middle of rendering
+  * the window it belongs to. The renderer's state is restored afterwards
+  * with ImDrawCallback_ResetRenderState.
+  */
+class TextLayer {
+public:
+  TextLayer();
+  ~TextLayer();
+
+  TextLayer(const TextLayer&) = delete;
+  TextLayer& operator=(const TextLayer&) = delete;
+
+  void invalidate() { mIsValid = false; }
+
+  /** Free the geometry and its buffers, which are rebuilt when drawing
+    * the next time. Must not be called while a frame is in progress.
+    */
+  void releaseMemory();
+
+  /** True if the current geometry covers rows [firstRow, lastRow). */
+  bool covers(std::size_t firstRow, std::size_t lastRow) const
+  {
+    return mIsValid && firstRow >= mFirstRow && lastRow <= mLastRow;
+  }
+
+  /** Start building new geometry, for rows starting at firstRow.
+    *
+    * Returns the draw list to add rows to, with the first row at the
+    * origin.
+    */
+  ImDrawList& beginBuild(std::size_t firstRow);
+
+  /** True if a row needing up to the given number of vertices still fits. */
+  bool hasRoomFor(std::size_t vertexCount) const;
+
+  /** Finish building. Rows up to lastRow were added, the longest of them
+    * being width pixels wide.
+    */
+  void endBuild(std::size_t lastRow, float width);
+
+  std::size_t firstRow() const { return mFirstRow; }
+  float width() const { return mWidth; }
+
+  /** Draw the layer into the current window, with its first row at the
+    * given screen position.
+    */
+  void draw(const ImVec2& position);
+
+private:
+  static void render(const ImDrawList* pParentList, const ImDrawCmd* pCommand);
+  void upload();
+
+  ImDrawList mGeometry;
+  std::size_t mFirstRow = 0;
+  std::size_t mLastRow = 0;
+  float mWidth = 0.0f;
+  bool mIsValid = false;
+
+  ImVec2 mTranslation;
+
+  // Only created once actually rendering
+  unsigned int mVertexBuffer = 0;
+  unsigned int mIndexBuffer = 0;
+  bool mNeedsUpload = false;
+};
@@ -0,0 +1,183 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "text_search.hpp"
+
+#include "substring_scan.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+
+namespace
+{
+
+// Amount of text to search between checks for new queries
+constexpr auto CHUNK_SIZE = std::uint64_t{256 * 1024};
+
+}
+
+
+TextSearch::TextSearch(
+  const TextBuffer& text,
+  std::function<void()> onProgress)
+  : mText(text)
+  , mOnProgress(std::move(onProgress))
+{
+  mThread = std::thread([this]() { searchLoop(); });
+}
+
+
+TextSearch::~TextSearch()
+{
+  {
+    std::lock_guard<std::mutex> lock(mStateMutex);
+    mStop = true;
+  }
+
+  mWakeUp.notify_one();
+  mThread.join();
+}
+
+
+void TextSearch::start(std::string query)
+{
+  {
+    std::lock_guard<std::mutex> lock(mStateMutex);
+    mQuery = std::move(query);
+    ++mGeneration;
+    mSearchedOffset = mText.startOffset();
+    mTextEnd = mText.endOffset();
+    mNewMatches.clear();
+  }
+
+  mWakeUp.notify_one();
+}
+
+
+void TextSearch::textChanged()
+{
+  {
+    std::lock_guard<std::mutex> lock(mStateMutex);
+    mTextEnd = mText.endOffset();
+  }
+
+  mWakeUp.notify_one();
+}
+
+
+bool TextSearch::takeMatches(std::deque<std::uint64_t>& matches)
+{
+  const auto madeProgress = mNotificationPending.exchange(false);
+
+  std::lock_guard<std::mutex> lock(mStateMutex);
+  matches.insert(matches.end(), mNewMatches.begin(), mNewMatches.end());
+  mNewMatches.clear();
+  return madeProgress;
+}
+
+
+std::uint64_t TextSearch::searchedOffset() const
+{
+  std::lock_guard<std::mutex> lock(mStateMutex);
+  return mSearchedOffset;
+}
+
+
+void TextSearch::searchLoop()
+{
+  std::vector<std::uint64_t> matches;
+
+  std::unique_lock<std::mutex> stateLock(mStateMutex);
+  for (;;)
+  {
+    mWakeUp.wait(stateLock, [this]()
+    {
+      return mStop || (!mQuery.empty() && mSearchedOffset < mTextEnd);
+    });
+
+    if (mStop)
+    {
+      break;
+    }
+
+    // Work on a copy, so that the UI thread can start a new search while
+    // we're busy.
+    const auto query = mQuery;
+    const auto generation = mGeneration;
+    const auto searchedOffset = mSearchedOffset;
+    const auto chunkEnd = std::min(mTextEnd, searchedOffset + CHUNK_SIZE);
+    stateLock.unlock();
+
+    matches.clear();
+    {
+      const auto textLock = std::lock_guard<std::mutex>{mTextMutex};
+
+      // Matches ending before the searched offset were found already. Text
+      // might have been discarded in the meantime, or be newer than the
+      // query, in which case this range is stale and thrown away below.
+      const auto begin = std::max(
+        searchedOffset - std::min<std::uint64_t>(searchedOffset, query.size() - 1),
+        mText.startOffset());
+      const auto end = std::min(chunkEnd, mText.endOffset());
+      // Text that can't be mapped can't be searched either, so it's
+      // skipped instead of taking down the whole process from this thread.
+      if (begin < end)
+      {
+        try
+        {
+          const auto range = mText.range(begin, end);
+          const auto pBegin = range.data();
+          forEachMatch(
+            pBegin,
+            pBegin + range.size(),
+            query.data(),
+            query.size(),
+            [&](const char* pMatch)
+            {
+              matches.push_back(begin + (pMatch - pBegin));
+            });
+        }
+        catch (const std::exception&)
+        {
+          matches.clear();
+        }
+      }
+    }
+
+    stateLock.lock();
+    if (generation != mGeneration)
+    {
+      continue;
+    }
+
+    mNewMatches.insert(mNewMatches.end(), matches.begin(), matches.end());
+    mSearchedOffset = chunkEnd;
+
+    if (mOnProgress && !mNotificationPending.exchange(true))
+    {
+      stateLock.unlock();
+      mOnProgress();
+      stateLock.lock();
+    }
+  }
+}
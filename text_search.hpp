@@ -0,0 +1,104 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "text_buffer.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/** Finds all occurrences of a query in a text buffer, on a background
+  * thread.
+  *
+  * The text is scanned in chunks, and matches are handed to the UI thread
+  * in order as they are found, so the first ones can be shown right away
+  * while the rest of a large file is still being searched. When text is
+  * appended, only the new part (plus enough of the old one for matches
+  * spanning both) is scanned.
+  *
+  * The UI thread must hold the lock returned by lockText() while modifying
+  * the text buffer. Reading it without the lock is fine, since the search
+  * thread never modifies it. The search thread notifies the UI thread via
+  * the given callback when it made progress, coalesced until the next call
+  * to takeMatches().
+  */
+class TextSearch {
+public:
+  TextSearch(const TextBuffer& text, std::function<void()> onProgress);
+  ~TextSearch();
+
+  TextSearch(const TextSearch&) = delete;
+  TextSearch& operator=(const TextSearch&) = delete;
+
+  /** Search the whole text for the given query, abandoning the previous
+    * search. An empty query doesn't search at all.
+    */
+  void start(std::string query);
+
+  const std::string& query() const { return mQuery; }
+
+  std::unique_lock<std::mutex> lockText()
+  {
+    return std::unique_lock<std::mutex>{mTextMutex};
+  }
+
+  /** Must be called after appending to or discarding from the text. */
+  void textChanged();
+
+  /** Append offsets of matches found since the last call to the given
+    * container, in ascending order. Returns true if the search made any
+    * progress since.
+    */
+  bool takeMatches(std::deque<std::uint64_t>& matches);
+
+  /** Offset up to which the text has been searched. */
+  std::uint64_t searchedOffset() const;
+
+private:
+  void searchLoop();
+
+  const TextBuffer& mText;
+  std::function<void()> mOnProgress;
+
+  std::mutex mTextMutex;
+
+  // Everything below is guarded by mStateMutex.
+  mutable std::mutex mStateMutex;
+  std::condition_variable mWakeUp;
+  std::string mQuery;
+  std::uint64_t mGeneration = 0;
+  std::uint64_t mSearchedOffset = 0;
+  std::uint64_t mTextEnd = 0;
+  std::vector<std::uint64_t> mNewMatches;
+  bool mStop = false;
+
+  std::atomic<bool> mNotificationPending{false};
+  std::thread mThread;
+};
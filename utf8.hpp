@@ -0,0 +1,304 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+/** Find the first byte in [p, pEnd) which isn't ASCII, or pEnd if there is
+  * none.
+  *
+  * Looks at 16 bytes at a time where SSE2 or NEON are available, which
+  * makes checking mostly-ASCII text almost free.
+  */
+inline const char* findNonAscii(const char* p, const char* pEnd)
+{
+#if defined(__SSE2__)
+  for (; pEnd - p >= 16; p += 16)
+  {
+    // The sign bit is exactly the non-ASCII bit.
+    const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(block));
+    if (mask)
+    {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__ARM_NEON)
+  for (; pEnd - p >= 16; p += 16)
+  {
+    const auto block = vld1q_u8(reinterpret_cast<const std::uint8_t*>(p));
+    const auto nonAscii = vcgeq_u8(block, vdupq_n_u8(0x80));
+
+    // No movemask, and no vmaxvq_u8() on 32-bit ARM either. Narrowing as
+    // in forEachNewline() gives 4 bits per input byte.
+    const auto mask = vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(nonAscii), 4)), 0);
+    if (mask)
+    {
+      return p + (__builtin_ctzll(mask) >> 2);
+    }
+  }
+#endif
+
+  for (; p < pEnd; ++p)
+  {
+    if (static_cast<unsigned char>(*p) >= 0x80)
+    {
+      return p;
+    }
+  }
+
+  return pEnd;
+}
+
+
+/** Classify the UTF-8 sequence starting at p, following RFC 3629.
+  *
+  * Returns the length of a valid sequence, 0 if [p, pEnd) ends in the
+  * middle of a sequence that's valid so far, or the negated length of the
+  * invalid part otherwise. Like in the Unicode standard's "maximal subpart"
+  * practice, the invalid part is the longest prefix of a valid sequence,
+  * or at least one byte. Overlong forms, surrogates and code points beyond
+  * U+10FFFF are invalid.
+  */
+inline int classifyUtf8Sequence(const char* p, const char* pEnd)
+{
+  const auto lead = static_cast<unsigned char>(*p);
+  if (lead < 0x80)
+  {
+    return 1;
+  }
+
+  auto length = 0;
+  unsigned char minNext = 0x80;
+  unsigned char maxNext = 0xBF;
+  if (lead >= 0xC2 && lead <= 0xDF)
+  {
+    length = 2;
+  }
+  else if (lead >= 0xE0 && lead <= 0xEF)
+  {
+    length = 3;
+    minNext = lead == 0xE0 ? 0xA0 : 0x80;
+    maxNext = lead == 0xED ? 0x9F : 0xBF;
+  }
+  else if (lead >= 0xF0 && lead <= 0xF4)
+  {
+    length = 4;
+    minNext = lead == 0xF0 ? 0x90 : 0x80;
+    maxNext = lead == 0xF4 ? 0x8F : 0xBF;
+  }
+  else
+  {
+    return -1;
+  }
+
+  for (auto i = 1; i < length; ++i)
+  {
+    if (p + i == pEnd)
+    {
+      return 0;
+    }
+
+    const auto next = static_cast<unsigned char>(p[i]);
+    if (next < minNext || next > maxNext)
+    {
+      return -i;
+    }
+
+    // Only the second byte has a restricted range.
+    minNext = 0x80;
+    maxNext = 0xBF;
+  }
+
+  return length;
+}
+
+
+/** Find the first invalid or incomplete UTF-8 sequence in [p, pEnd), or
+  * pEnd if the text is valid.
+  */
+inline const char* findInvalidUtf8(const char* p, const char* pEnd)
+{
+  for (;;)
+  {
+    p = findNonAscii(p, pEnd);
+    if (p == pEnd)
+    {
+      return pEnd;
+    }
+
+    // Text with non-ASCII characters tends to have them in runs, so check
+    // the following ones right here.
+    do
+    {
+      const auto length = classifyUtf8Sequence(p, pEnd);
+      if (length <= 0)
+      {
+        return p;
+      }
+
+      p += length;
+    }
+    while (p < pEnd && static_cast<unsigned char>(*p) >= 0x80);
+  }
+}
+
+
+inline bool isValidUtf8(const char* pBegin, const char* pEnd)
+{
+  return findInvalidUtf8(pBegin, pEnd) == pEnd;
+}
+
+
+/** Return [pBegin, pEnd) as valid UTF-8, for handing it to ImGui, which
+  * stops drawing at the first invalid byte.
+  *
+  * Valid text is returned as is. Otherwise, it's copied to scratch, with
+  * each byte of an invalid or incomplete sequence replaced by a '?', and
+  * the copy is returned. Either way, the result has the same length, so
+  * offsets into the text apply to it as well.
+  */
+inline const char* sanitizeUtf8(
+  const char* pBegin,
+  const char* pEnd,
+  std::string& scratch)
+{
+  const auto pInvalid = findInvalidUtf8(pBegin, pEnd);
+  if (pInvalid == pEnd)
+  {
+    return pBegin;
+  }
+
+  scratch.assign(pBegin, pEnd);
+  const auto pCopyEnd = scratch.data() + scratch.size();
+  for (auto p = scratch.data() + (pInvalid - pBegin); p < pCopyEnd; )
+  {
+    const auto length = classifyUtf8Sequence(p, pCopyEnd);
+    const auto invalidLength = length == 0 ? pCopyEnd - p : -length;
+    std::memset(p, '?', std::size_t(invalidLength));
+    p = const_cast<char*>(findInvalidUtf8(p + invalidLength, pCopyEnd));
+  }
+
+  return scratch.data();
+}
+
+
+/** Replaces invalid UTF-8 in text that arrives in pieces, the same way as
+  * sanitizeUtf8(), so that it doesn't need checking when it's drawn.
+  *
+  * A sequence cut off at the end of a piece is held back until the next
+  * piece completes it.
+  */
+class Utf8Sanitizer {
+public:
+  /** Call emit(const char* pBegin, const char* pEnd) for consecutive parts
+    * of the sanitized text.
+    */
+  template <typename Func>
+  void sanitize(const char* p, const char* const pEnd, Func&& emit)
+  {
+    // Complete the pending sequence first, a byte at a time. A byte which
+    // doesn't fit in starts over with the rest of the text.
+    while (mPendingSize > 0 && p < pEnd)
+    {
+      mPending[mPendingSize++] = *p++;
+      const auto length = classifyUtf8Sequence(mPending, mPending + mPendingSize);
+      if (length > 0)
+      {
+        emit(mPending, mPending + length);
+        mPendingSize = 0;
+      }
+      else if (length < 0)
+      {
+        --p;
+        --mPendingSize;
+        emit(REPLACEMENT, REPLACEMENT + mPendingSize);
+        mPendingSize = 0;
+      }
+    }
+
+    auto pValid = p;
+    while (p < pEnd)
+    {
+      const auto pInvalid = findInvalidUtf8(p, pEnd);
+      if (pInvalid == pEnd)
+      {
+        break;
+      }
+
+      if (pValid < pInvalid)
+      {
+        emit(pValid, pInvalid);
+      }
+
+      const auto length = classifyUtf8Sequence(pInvalid, pEnd);
+      if (length == 0)
+      {
+        mPendingSize = std::size_t(pEnd - pInvalid);
+        std::memcpy(mPending, pInvalid, mPendingSize);
+        return;
+      }
+
+      emit(REPLACEMENT, REPLACEMENT - length);
+      p = pValid = pInvalid - length;
+    }
+
+    if (pValid < pEnd)
+    {
+      emit(pValid, pEnd);
+    }
+  }
+
+  /** The text has ended. A sequence that's still incomplete is replaced. */
+  template <typename Func>
+  void finish(Func&& emit)
+  {
+    if (mPendingSize > 0)
+    {
+      emit(REPLACEMENT, REPLACEMENT + mPendingSize);
+      mPendingSize = 0;
+    }
+  }
+
+  /** Start over with a new stream of text. */
+  void reset() { mPendingSize = 0; }
+
+private:
+  // An invalid part is at most 3 bytes, each of which is replaced.
+  static constexpr const char* REPLACEMENT = "???";
+
+  char mPending[4] = {};
+  std::size_t mPendingSize = 0;
+};
+
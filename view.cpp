@@ -21,84 +21,366 @@
 
 #include "view.hpp"
 
+#include "utf8.hpp"
+
 #include "imgui_internal.h"
 
-#include <poll.h>
 #include <unistd.h>
 
-#include <sstream>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <stdexcept>
 
 
+namespace
+{
+
+// Amount of text to scan for glyphs before the first frame
+constexpr auto FONT_PRELOAD_SIZE = std::size_t{64 * 1024};
+
+// Amount of text to index before the first frame. The rest is indexed in
+// the background.
+constexpr auto INITIAL_INDEX_SIZE = std::uint64_t{256 * 1024};
+
+// Files this large get a sparse line index, keeping every Nth line start.
+constexpr auto SPARSE_INDEX_MIN_SIZE = std::size_t{64 * 1024 * 1024};
+constexpr auto SPARSE_INDEX_INTERVAL = std::size_t{256};
+
+// While indexing, text beyond the indexed part is shown by indexing this
+// much of the text around the position scrolled to.
+constexpr auto SEEK_WINDOW_SIZE = std::uint64_t{256 * 1024};
+
+// Decompressed or converted text beyond this is discarded, oldest first,
+// unless there's a limit given
+constexpr auto DEFAULT_DECOMPRESSED_SIZE_LIMIT = std::size_t{128 * 1024 * 1024};
+
+// Minimum amount of text to read ahead when scrolling
+constexpr auto MIN_PREFETCH_SIZE = std::uint64_t{64 * 1024};
+
+constexpr auto STYLE_SCRIPT_ERROR = StyleId{1};
+
+
+/** Call func(partBegin, partEnd, style) for consecutive parts of the given
+  * range with the same style. An empty range is a single empty part.
+  */
+template <typename Func>
+void forEachStyledPart(
+  const StyleSpans& spans,
+  const std::uint64_t begin,
+  const std::uint64_t end,
+  Func&& func)
+{
+  auto position = begin;
+  spans.forEachSpan(
+    begin,
+    end,
+    [&](const std::uint64_t spanBegin, const std::uint64_t spanEnd, const StyleId style)
+    {
+      if (spanBegin > position)
+      {
+        func(position, spanBegin, StyleId{0});
+      }
+
+      func(spanBegin, spanEnd, style);
+      position = spanEnd;
+    });
+
+  if (position < end || begin == end)
+  {
+    func(position, end, StyleId{0});
+  }
+}
+
+
+ImU32 styleColor(const StyleId style)
+{
+  if (isAnsiStyle(style))
+  {
+    const auto color = ansiPaletteColor(std::uint8_t(style));
+    return IM_COL32(color >> 16, (color >> 8) & 0xff, color & 0xff, 255);
+  }
+
+  switch (style)
+  {
+    case STYLE_SCRIPT_ERROR:
+      return IM_COL32(255, 110, 110, 255);
+
+    default:
+      return ImGui::GetColorU32(ImGuiCol_Text);
+  }
+}
+
+}
+
+
 View::View(
   std::string windowTitle,
-  std::string inputTextOrScriptFile,
+  TextBuffer inputTextOrScriptFile,
   const bool showYesNoButtons,
   const bool wrapLines,
-  const bool inputTextIsScriptFile)
+  const InputSource inputSource,
+  const std::optional<StreamReader::Clock::duration> scriptReadBudget,
+  const bool killScriptOnExit,
+  const ScrollbackLimits scrollbackLimits,
+  const std::size_t lineCacheSize,
+  const std::size_t maxMappedSize,
+  const std::string& encoding,
+  std::function<void()> onScriptOutput,
+  std::unique_ptr<FileFollower> pFileFollower,
+  DynamicFontAtlas* pFontAtlas)
   : mTitle(std::move(windowTitle))
-  , mText([&]() -> decltype(mText) {
-      if (inputTextIsScriptFile)
-      {
-        if (wrapLines)
-        {
-          return std::vector<std::string>{};
-        }
-        else
-        {
-          return "";
-        }
-      }
-
-      return std::move(inputTextOrScriptFile);
-    }())
-  , mpScriptPipe(nullptr)
-  , mScriptPipeFd(-1)
+  , mText(
+      inputSource == InputSource::Text && encoding.empty()
+        ? std::move(inputTextOrScriptFile)
+        : TextBuffer{})
+  , mScrollbackLimits(scrollbackLimits)
+  , mMaxMappedSize(maxMappedSize)
+  , mOutputDecoder(encoding)
+  , mErrorOutputDecoder(encoding)
+  , mTextDecoder(encoding)
+  , mpFileFollower(std::move(pFileFollower))
+  , mpFontAtlas(pFontAtlas)
+  , mOnProgress(onScriptOutput)
   , mShowYesNoButtons(showYesNoButtons)
+  , mWrapLines(wrapLines)
 {
   // We are executing a script instead of showing some text.
-  // Start executing it, and grab the file descriptor for polling.
-  if (inputTextIsScriptFile)
+  // Start executing it, and start reading its output.
+  if (inputSource == InputSource::ScriptFile)
   {
-    mpScriptPipe = popen((inputTextOrScriptFile + " 2>&1 ").c_str(), "r");
-    if (!mpScriptPipe)
+    const auto range = inputTextOrScriptFile.range(
+      inputTextOrScriptFile.startOffset(),
+      inputTextOrScriptFile.endOffset());
+    const auto command = std::string{range.data(), range.size()};
+    mpScript = std::make_unique<ChildProcess>(command, killScriptOnExit, onScriptOutput);
+    mpScriptReader = std::make_unique<StreamReader>(
+      mpScript->outputFd(), scriptReadBudget, onScriptOutput);
+    mpScriptErrorReader = std::make_unique<StreamReader>(
+      mpScript->errorFd(), scriptReadBudget, std::move(onScriptOutput));
+  }
+  else if (inputSource == InputSource::Stdin)
+  {
+    // Same as script output, only without a process or stderr.
+    mpScriptReader = std::make_unique<StreamReader>(
+      STDIN_FILENO, scriptReadBudget, std::move(onScriptOutput));
+  }
+  else if (inputSource == InputSource::CompressedFile || mTextDecoder.isConverting())
+  {
+    // Text in another encoding is converted while it's being shown, in
+    // chunks, the same way as decompressed text.
+    mpDecompressor = std::make_unique<Decompressor>(
+      std::move(inputTextOrScriptFile), std::move(onScriptOutput));
+  }
+  else
+  {
+    // Keeping the start of each line needs memory proportional to the
+    // number of lines, which can be too much for a large file. With
+    // scrollback limits, memory is bounded anyway.
+    if (
+      mText.size() >= SPARSE_INDEX_MIN_SIZE &&
+      !mScrollbackLimits.maxLines &&
+      !mScrollbackLimits.maxBytes)
     {
-      throw std::runtime_error("Failed to execute script");
+      mLineIndex.makeSparse(
+        SPARSE_INDEX_INTERVAL,
+        lineCacheSize / (SPARSE_INDEX_INTERVAL * sizeof(std::uint64_t)));
     }
 
-    mScriptPipeFd = fileno(mpScriptPipe);
-    if (mScriptPipeFd == -1)
-    {
-      pclose(mpScriptPipe);
-      throw std::runtime_error("Failed to execute script");
-    }
+    mUncheckedEnd = mText.endOffset();
+    indexLoadedText();
+  }
+
+  applySizeLimit();
+
+  // Get glyphs for the first screen of text into the font atlas before the
+  // first frame, instead of discovering them while drawing it.
+  if (mpFontAtlas)
+  {
+    mpFontAtlas->addText(mTitle.data(), mTitle.data() + mTitle.size());
+    const auto range = mText.range(
+      mText.startOffset(),
+      mText.startOffset() + std::min<std::uint64_t>(mText.size(), FONT_PRELOAD_SIZE));
+    mpFontAtlas->addText(range.data(), range.data() + range.size());
+  }
+}
+
+
+View::~View()
+{
+  closeScriptPipe();
+}
+
+
+void View::releaseCaches()
+{
+  mWrapLayout.invalidate();
+  mSeekLayout.invalidate();
+  mTextLayer.releaseMemory();
+  mText.releasePages(mText.startOffset(), mText.endOffset());
+}
+
+
+std::optional<int> View::scriptExitStatus()
+{
+  return mpScript ? mpScript->exitStatus() : std::nullopt;
+}
+
+
+bool View::update()
+{
+  auto textChanged = false;
+  auto textLoaded = false;
+  {
+    // The search thread must not read the text while it changes.
+    const auto textLock = mpSearch
+      ? mpSearch->lockText()
+      : std::unique_lock<std::mutex>{};
+
+    // We are executing a script instead of showing some text.
+    // Fetch output from the script and append it to our text buffer.
+    // Appending to a followed file would replace the text (and its
+    // mapping) while it is being indexed, so that waits until the
+    // indexer is done, or the text was converted.
+    textChanged =
+      (mpScriptReader && fetchScriptOutput()) ||
+      (mpFileFollower && !mpLineIndexer && !mpDecompressor && fetchFollowedText());
+
+    // Like indexing, this is the initial text, which doesn't scroll.
+    textLoaded = mpDecompressor && fetchDecompressedText();
+  }
+
+  // Reap the script as soon as it exits, even while something it started
+  // in the background keeps its output open.
+  if (mpScript && mpScript->hasExited())
+  {
+    mpScript->exitStatus();
   }
-  else if (wrapLines)
+
+  // More lines in the initial text only make the scroll area grow, and
+  // don't scroll to the end.
+  auto linesIndexed = false;
+  if (mpLineIndexer)
   {
-    std::stringstream stream{std::get<std::string>(mText)};
-    std::vector<std::string> lines;
-    for (std::string line; std::getline(stream, line); )
+    linesIndexed = mpLineIndexer->takeLines(mLineIndex);
+    if (mpLineIndexer->isFinished())
     {
-      lines.push_back(line);
+      // Text that couldn't be read isn't shown, which is noted next to
+      // the buttons.
+      mIndexingFailed = mpLineIndexer->hasFailed();
+      mpLineIndexer.reset();
+
+      // Redraw without the progress indicator. This also makes sure that
+      // changes to the followed file made meanwhile get picked up soon.
+      linesIndexed = true;
     }
+  }
 
-    mText = std::move(lines);
+  // New text only scrolls the view if it was showing the end already.
+  if (textChanged)
+  {
+    mScrollToEnd = mIsScrolledToEnd;
+  }
+
+  // Rows might show different text now, even if there are as many as before.
+  if (textChanged || textLoaded || linesIndexed)
+  {
+    mTextLayer.invalidate();
+  }
+
+  if ((textChanged || textLoaded) && mpSearch)
+  {
+    mpSearch->textChanged();
+  }
+
+  // Bookmarks in discarded text are gone along with it.
+  if (textChanged)
+  {
+    mBookmarks.erase(
+      mBookmarks.begin(),
+      std::lower_bound(mBookmarks.begin(), mBookmarks.end(), mText.startOffset()));
+  }
+
+  const auto searchProgressed = mpSearch && mpSearch->takeMatches(mMatches);
+  if (searchProgressed || textChanged || textLoaded)
+  {
+    discardMatches();
   }
+
+  return textChanged || textLoaded || linesIndexed || searchProgressed;
 }
 
 
-View::~View()
+void View::openSearch(const bool onScreenKeyboard)
 {
-  closeScriptPipe();
+  if (!mpSearch)
+  {
+    mpSearch = std::make_unique<TextSearch>(mText, mOnProgress);
+  }
+
+  // The input field would take the d-pad for moving its cursor.
+  if (onScreenKeyboard)
+  {
+    mShowKeyboard = true;
+    mFocusKeyboard = true;
+  }
+  else
+  {
+    mFocusSearchInput = true;
+  }
+}
+
+
+void View::jumpToMatch(const int direction)
+{
+  // Scrolling needs the layout of the current frame, so this happens
+  // while drawing.
+  mPendingJump = direction;
+}
+
+
+void View::scrollPages(const int pages)
+{
+  mPendingPages += pages;
+}
+
+
+void View::scrollToFraction(const float fraction)
+{
+  mPendingFraction = std::clamp(fraction, 0.0f, 1.0f);
+  mPendingScrub = 0.0f;
+  mPendingPages = 0;
+}
+
+
+void View::scrollByFraction(const float fraction)
+{
+  mPendingScrub += fraction;
+}
+
+
+void View::toggleBookmark()
+{
+  mPendingBookmarkToggle = !mPendingBookmarkToggle;
+}
+
+
+void View::jumpToBookmark(const int direction)
+{
+  mPendingBookmarkJump = direction;
 }
 
 
-std::optional<int> View::draw(const ImVec2& windowSize)
+std::optional<int> View::draw(
+  const ImVec2& windowSize,
+  const std::function<void()>& drawTabs)
 {
   ImGui::SetNextWindowSize(windowSize);
   ImGui::SetNextWindowPos(ImVec2(0, 0));
 
-  bool scroll = false;
   auto running = true;
   ImGui::Begin(
     mTitle.c_str(),
@@ -106,6 +388,21 @@ std::optional<int> View::draw(const ImVec2& windowSize)
     ImGuiWindowFlags_NoCollapse |
     ImGuiWindowFlags_NoResize);
 
+  if (drawTabs)
+  {
+    drawTabs();
+  }
+
+  if (mpSearch)
+  {
+    drawSearchBar();
+  }
+
+  if (mShowKeyboard)
+  {
+    drawSearchKeyboard();
+  }
+
   const auto buttonSpaceRequired =
     ImGui::CalcTextSize("Close", nullptr, true).y +
     ImGui::GetStyle().FramePadding.y * 2.0f;
@@ -113,44 +410,127 @@ std::optional<int> View::draw(const ImVec2& windowSize)
     ImGui::GetStyle().ItemSpacing.y -
     buttonSpaceRequired;
 
-  if (ImGui::IsWindowAppearing() && !mShowYesNoButtons)
+  // Scrolling with the d-pad needs the text focused, also after closing
+  // the on-screen keyboard.
+  if ((ImGui::IsWindowAppearing() && !mShowYesNoButtons) || mFocusText)
   {
     ImGui::SetNextWindowFocus();
+    mFocusText = false;
   }
 
+  // Keep showing the same text while lines above it are dropped. This has
+  // to happen before the child window begins, to take effect in this frame.
+  if (mRowsDiscarded > 0 && mpScrollArea && !mScrollToEnd)
+  {
+    ImGui::SetScrollY(
+      mpScrollArea,
+      std::max(0.0f, mpScrollArea->Scroll.y - mRowsDiscarded * ImGui::GetTextLineHeight()));
+  }
+
+  mRowsDiscarded = 0;
+  mRowsSubmitted = 0;
+
+  applyPendingScroll();
+
   ImGui::BeginChild(
     "#scroll_area",
     {0, maxTextHeight},
     true,
     ImGuiWindowFlags_HorizontalScrollbar);
+  mpScrollArea = ImGui::GetCurrentWindow();
 
-  // We are executing a script instead of showing some text.
-  // Fetch output from the script and append it to our text buffer.
-  if (mpScriptPipe)
-  {
-    scroll = fetchScriptOutput();
-  }
+  // Draw the text buffer. Lines are laid out back to back, so that the
+  // height of the text can be derived from the line layout alone.
+  ImGui::PushStyleVar(
+    ImGuiStyleVar_ItemSpacing,
+    {ImGui::GetStyle().ItemSpacing.x, 0.0f});
 
-  // Draw the text buffer.
-  if (const auto pText = std::get_if<std::string>(&mText))
+  if (mWrapLines)
   {
-    ImGui::TextUnformatted(pText->c_str());
+    // Only lines that are new or changed since the last frame are laid out
+    // here, unless the available width or font changed. Lines indexed
+    // while seeking are laid out as well, so that they don't all need to
+    // be laid out at once when the main index is shown again.
+    mWrapWidth = ImGui::GetContentRegionAvail().x;
+    mWrapLayout.update(
+      mText, mLineIndex, ImGui::GetFont(), ImGui::GetFontSize(), mWrapWidth);
+    if (mIsSeeking)
+    {
+      mSeekLayout.update(
+        mText, mSeekLines, ImGui::GetFont(), ImGui::GetFontSize(), mWrapWidth);
+    }
   }
-  else if (const auto pLines = std::get_if<std::vector<std::string>>(&mText))
+
+  const auto textOrigin = ImGui::GetCursorScreenPos();
+
+  // Text that's too long for the retained layer is drawn item by item.
+  if (!drawTextLayer())
   {
-    for (const auto& line : *pLines)
+    if (mWrapLines)
     {
-      ImGui::TextWrapped(line.c_str());
+      drawWrappedLines();
     }
+    else
+    {
+      drawLines();
+    }
+  }
+
+  ImGui::PopStyleVar();
+
+  drawBookmarks(textOrigin);
+
+  if (mPendingJump != 0)
+  {
+    selectMatch(mPendingJump);
+    mPendingJump = 0;
   }
 
-  if (scroll)
+  applyPendingNavigation();
+  moveSeekWindow();
+
+  if (mScrollToEnd)
   {
-    ImGui::SetScrollHere(1.0);
+    ImGui::SetScrollHereY(1.0f);
+    mScrollToEnd = false;
+    mIsScrolledToEnd = true;
+  }
+  else
+  {
+    mIsScrolledToEnd =
+      ImGui::GetScrollY() >= ImGui::GetScrollMaxY() - ImGui::GetTextLineHeight() / 2.0f;
   }
 
   ImGui::EndChild();
 
+  // Shown next to the buttons until the whole text is indexed
+  if (mpLineIndexer)
+  {
+    ImGui::AlignTextToFramePadding();
+    ImGui::TextDisabled(
+      "indexing %d%%",
+      int(mpLineIndexer->indexedOffset() * 100 / std::max<std::uint64_t>(mText.endOffset(), 1)));
+    ImGui::SameLine();
+  }
+  else if (mIndexingFailed)
+  {
+    ImGui::AlignTextToFramePadding();
+    ImGui::TextDisabled(
+      "failed to read the file after %d%%",
+      int(mLineIndex.indexedSize() * 100 / std::max<std::uint64_t>(mText.endOffset(), 1)));
+    ImGui::SameLine();
+  }
+  else if (mpDecompressor)
+  {
+    ImGui::AlignTextToFramePadding();
+    ImGui::TextDisabled(
+      mpDecompressor->compression() == Compression::None
+        ? "converting %d%%"
+        : "decompressing %d%%",
+      int(mpDecompressor->progress() * 100.0f));
+    ImGui::SameLine();
+  }
+
   // Draw buttons
   if (mShowYesNoButtons) {
     const auto buttonWidth = windowSize.x / 3.0f;
@@ -199,85 +579,1199 @@ std::optional<int> View::draw(const ImVec2& windowSize)
 }
 
 
-bool View::fetchScriptOutput()
+void View::drawText(const std::uint64_t begin, const std::uint64_t end)
 {
-  bool gotNewData = false;
+  const auto range = mText.range(begin, end);
+  const auto pBegin = begin < mUncheckedEnd
+    ? sanitizeUtf8(range.data(), range.data() + range.size(), mSanitizedText)
+    : range.data();
+
+  if (mpFontAtlas)
+  {
+    mpFontAtlas->addText(pBegin, pBegin + (end - begin));
+  }
 
-  // Check if there is new data available from the script's output
-  struct pollfd pollData{mScriptPipeFd, POLLIN, 0};
-  const auto result = poll(&pollData, 1, 0);
+  // Highlight the current match behind the text, if it's in this part.
+  const auto [matchBegin, matchEnd] = highlightedRange(begin, end);
+  if (matchBegin < matchEnd)
+  {
+    const auto position = ImGui::GetCursorScreenPos();
+    const auto x1 = position.x +
+      ImGui::CalcTextSize(pBegin, pBegin + (matchBegin - begin)).x;
+    const auto x2 = position.x +
+      ImGui::CalcTextSize(pBegin, pBegin + (matchEnd - begin)).x;
+    ImGui::GetWindowDrawList()->AddRectFilled(
+      {x1, position.y},
+      {x2, position.y + ImGui::GetTextLineHeight()},
+      ImGui::GetColorU32(ImGuiCol_TextSelectedBg));
+  }
 
-  if (result > 0)
+  // Common case, nothing special to draw
+  if (mStyleSpans.empty())
   {
-    if (pollData.revents & POLLIN)
+    ImGui::TextUnformatted(pBegin, pBegin + (end - begin));
+    return;
+  }
+
+  // Draw each differently styled part as a separate item, placed right
+  // after the previous one. They all end up in the same draw call, since
+  // the color is part of the vertex data.
+  auto isFirstPart = true;
+  forEachStyledPart(
+    mStyleSpans,
+    begin,
+    end,
+    [&](const std::uint64_t partBegin, const std::uint64_t partEnd, const StyleId style)
     {
-      // Data is available.
-      char bytes[1024];
-      const auto bytesRead = read(mScriptPipeFd, bytes, sizeof(bytes));
-      if (bytesRead == -1)
+      if (!isFirstPart)
       {
-        // Error reading the pipe
-        throw std::runtime_error("Error read()-ing script fd");
+        ImGui::SameLine(0.0f, 0.0f);
       }
 
-      if (bytesRead > 0)
+      if (style != 0)
       {
-        gotNewData = true;
+        ImGui::PushStyleColor(ImGuiCol_Text, styleColor(style));
+      }
 
-        // We read some output bytes, append them to our message,
-        // taking word-wrapping into account as needed.
-        if (const auto pText = std::get_if<std::string>(&mText))
-        {
-          // Word-wrapping is disabled, simply append the bytes we read to our
-          // string.
-          pText->insert(pText->end(), bytes, bytes + bytesRead);
-        }
-        else if (const auto pLines = std::get_if<std::vector<std::string>>(&mText))
-        {
-          // Word-wrapping is enabled, look for linebreaks and move on to
-          // the next line in the list of lines when we encouter one.
-          if (pLines->empty())
-          {
-            pLines->emplace_back(bytes, bytes + bytesRead);
-          }
-          else
-          {
-            for (auto pChar = bytes; pChar != bytes + bytesRead; ++pChar)
-            {
-              pLines->back().push_back(*pChar);
-
-              if (*pChar == '\n')
-              {
-                pLines->emplace_back();
-              }
-            }
-          }
-        }
+      const auto pPart = pBegin + (partBegin - begin);
+      ImGui::TextUnformatted(pPart, pPart + (partEnd - partBegin));
+
+      if (style != 0)
+      {
+        ImGui::PopStyleColor();
       }
+
+      isFirstPart = false;
+    });
+}
+
+
+float View::addTextGeometry(
+  ImDrawList& drawList,
+  const ImVec2& position,
+  const std::uint64_t begin,
+  const std::uint64_t end)
+{
+  const auto range = mText.range(begin, end);
+  const auto pBegin = begin < mUncheckedEnd
+    ? sanitizeUtf8(range.data(), range.data() + range.size(), mSanitizedText)
+    : range.data();
+
+  if (mpFontAtlas)
+  {
+    mpFontAtlas->addText(pBegin, pBegin + (end - begin));
+  }
+
+  // Same as drawText(), only straight into the given draw list instead of
+  // going through ImGui's items.
+  const auto pFont = ImGui::GetFont();
+  const auto fontSize = ImGui::GetFontSize();
+  const auto clipRect = ImVec4{-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX};
+  const auto textWidth = [&](const std::uint64_t partBegin, const std::uint64_t partEnd)
+  {
+    const auto pPart = pBegin + (partBegin - begin);
+    return pFont->CalcTextSizeA(fontSize, FLT_MAX, 0.0f, pPart, pPart + (partEnd - partBegin)).x;
+  };
+
+  const auto [matchBegin, matchEnd] = highlightedRange(begin, end);
+  if (matchBegin < matchEnd)
+  {
+    const auto x1 = position.x + textWidth(begin, matchBegin);
+    const auto x2 = position.x + textWidth(begin, matchEnd);
+    drawList.AddRectFilled(
+      {x1, position.y},
+      {x2, position.y + ImGui::GetTextLineHeight()},
+      ImGui::GetColorU32(ImGuiCol_TextSelectedBg));
+  }
+
+  auto x = position.x;
+  forEachStyledPart(
+    mStyleSpans,
+    begin,
+    end,
+    [&](const std::uint64_t partBegin, const std::uint64_t partEnd, const StyleId style)
+    {
+      const auto pPart = pBegin + (partBegin - begin);
+      pFont->RenderText(
+        &drawList,
+        fontSize,
+        {x, position.y},
+        styleColor(style),
+        clipRect,
+        pPart,
+        pPart + (partEnd - partBegin));
+      x += textWidth(partBegin, partEnd);
+    });
+
+  return x - position.x;
+}
+
+
+bool View::drawTextLayer()
+{
+  const auto rowCount = activeRowCount();
+  const auto lineHeight = ImGui::GetTextLineHeight();
+
+  // Rows laid out back to back from here, as with ImGui items
+  const auto origin = ImGui::GetCursorScreenPos();
+
+  const auto scrollY = ImGui::GetScrollY();
+  const auto firstVisibleRow = std::min(
+    rowCount, std::size_t(std::max(0.0f, scrollY) / lineHeight));
+  const auto lastVisibleRow = std::min(
+    rowCount, std::size_t((scrollY + ImGui::GetWindowHeight()) / lineHeight) + 1);
+
+  // Anything affecting the geometry, apart from the text itself
+  const auto currentMatch = mCurrentMatch
+    ? mMatches[*mCurrentMatch]
+    : std::numeric_limits<std::uint64_t>::max();
+  const auto layerKey = std::make_tuple(
+    rowCount, currentMatch, ImGui::GetFontSize(), ImGui::GetContentRegionAvail().x);
+  if (layerKey != mTextLayerKey)
+  {
+    mTextLayer.invalidate();
+    mTextLayerKey = layerKey;
+  }
+
+  if (!mTextLayer.covers(firstVisibleRow, lastVisibleRow))
+  {
+    // Build a screen's worth of extra rows in both directions, so that
+    // scrolling doesn't need a rebuild right away. If that's too much
+    // text, try again with only the visible rows.
+    const auto visibleRows = lastVisibleRow - firstVisibleRow;
+    if (
+      !buildTextLayer(
+        firstVisibleRow - std::min(firstVisibleRow, visibleRows),
+        std::min(rowCount, lastVisibleRow + visibleRows),
+        lastVisibleRow) &&
+      !buildTextLayer(firstVisibleRow, lastVisibleRow, lastVisibleRow))
+    {
+      return false;
+    }
+  }
+
+  mTextLayer.draw({origin.x, origin.y + mTextLayer.firstRow() * lineHeight});
+
+  // Let ImGui know about the size of the text, for scrolling.
+  ImGui::Dummy({mTextLayer.width(), rowCount * lineHeight});
+
+  if (lastVisibleRow > firstVisibleRow)
+  {
+    prefetchAround(
+      mWrapLines ? activeLayout().lineForRow(firstVisibleRow) : firstVisibleRow,
+      (mWrapLines ? activeLayout().lineForRow(lastVisibleRow - 1) : lastVisibleRow - 1) + 1);
+  }
+
+  return true;
+}
+
+
+bool View::buildTextLayer(
+  const std::size_t firstRow,
+  const std::size_t lastRow,
+  const std::size_t minLastRow)
+{
+  const auto lineHeight = ImGui::GetTextLineHeight();
+  auto& drawList = mTextLayer.beginBuild(firstRow);
+
+  auto width = 0.0f;
+  auto row = firstRow;
+  for (; row < lastRow; ++row)
+  {
+    std::uint64_t rowStart;
+    std::uint64_t rowEnd;
+    if (mWrapLines)
+    {
+      const auto line = activeLayout().lineForRow(row);
+      std::tie(rowStart, rowEnd) = activeLayout().rowRange(activeLines(), line, row);
+    }
+    else
+    {
+      rowStart = activeLines().lineStart(row);
+      rowEnd = activeLines().lineEnd(row);
     }
 
-    if (pollData.revents & POLLHUP || pollData.revents & POLLERR)
+    // Each character needs at most one quad, plus one for the highlight.
+    if (!mTextLayer.hasRoomFor((rowEnd - rowStart + 1) * 4))
     {
-      // The script is done, or an error occured - close the pipe
-      closeScriptPipe();
+      break;
     }
+
+    width = std::max(
+      width,
+      addTextGeometry(drawList, {0.0f, (row - firstRow) * lineHeight}, rowStart, rowEnd));
   }
-  else if (result < 0)
+
+  mRowsSubmitted += row - firstRow;
+  if (row < minLastRow)
   {
-    // Error polling the pipe
-    throw std::runtime_error("Error poll()-ing script fd");
+    return false;
   }
 
-  return gotNewData;
+  mTextLayer.endBuild(row, width);
+  return true;
 }
 
 
-void View::closeScriptPipe()
+void View::drawLines()
+{
+  // All lines have the same height without word-wrapping, so the clipper
+  // can tell which ones are visible without looking at the text.
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(activeLines().lineCount()));
+  while (clipper.Step())
+  {
+    for (auto i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+    {
+      drawText(activeLines().lineStart(i), activeLines().lineEnd(i));
+    }
+
+    mRowsSubmitted += clipper.DisplayEnd - clipper.DisplayStart;
+
+    prefetchAround(clipper.DisplayStart, clipper.DisplayEnd);
+  }
+  clipper.End();
+}
+
+
+void View::drawWrappedLines()
+{
+  // The layout has already broken lines into rows of equal height, so the
+  // clipper can work on rows instead of lines, and we can draw each row
+  // without having ImGui wrap it again.
+  ImGuiListClipper clipper;
+  clipper.Begin(static_cast<int>(activeLayout().rowCount()));
+  while (clipper.Step())
+  {
+    if (clipper.DisplayStart == clipper.DisplayEnd)
+    {
+      continue;
+    }
+
+    auto line = activeLayout().lineForRow(clipper.DisplayStart);
+    for (auto row = std::size_t(clipper.DisplayStart); row < std::size_t(clipper.DisplayEnd); ++row)
+    {
+      if (row == activeLayout().firstRow(line + 1))
+      {
+        ++line;
+      }
+
+      const auto [rowStart, rowEnd] = activeLayout().rowRange(activeLines(), line, row);
+      drawText(rowStart, rowEnd);
+    }
+
+    mRowsSubmitted += clipper.DisplayEnd - clipper.DisplayStart;
+
+    prefetchAround(activeLayout().lineForRow(clipper.DisplayStart), line + 1);
+  }
+  clipper.End();
+}
+
+
+void View::prefetchAround(const std::size_t firstLine, const std::size_t lastLine)
 {
-    if (mpScriptPipe)
+  // The clipper's first step only measures the first line.
+  if (firstLine == mFirstVisibleLine || lastLine <= firstLine + 1)
+  {
+    return;
+  }
+
+  // Read the next screen of text in the direction we're scrolling, so it's
+  // in memory by the time it's shown.
+  const auto begin = activeLines().lineStart(firstLine);
+  const auto end = activeLines().lineEnd(lastLine - 1);
+  const auto size = std::max(end - begin, MIN_PREFETCH_SIZE);
+  if (firstLine > mFirstVisibleLine)
+  {
+    mText.prefetch(end, end + size);
+  }
+  else
+  {
+    mText.prefetch(begin - std::min(begin, size), begin);
+  }
+
+  mFirstVisibleLine = firstLine;
+}
+
+
+void View::drawSearchBar()
+{
+  if (mFocusSearchInput)
+  {
+    ImGui::SetKeyboardFocusHere();
+    mFocusSearchInput = false;
+  }
+
+  ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x / 2.0f);
+  if (ImGui::InputTextWithHint(
+    "##search",
+    "Search",
+    mSearchInput.data(),
+    mSearchInput.size(),
+    ImGuiInputTextFlags_EnterReturnsTrue))
+  {
+    jumpToMatch(1);
+  }
+
+  // Only the text typed so far is searched, so matches show up as soon as
+  // possible.
+  if (std::strcmp(mSearchInput.data(), mpSearch->query().c_str()) != 0)
+  {
+    mMatches.clear();
+    mCurrentMatch.reset();
+    mpSearch->start(mSearchInput.data());
+  }
+
+  if (mpSearch->query().empty())
+  {
+    return;
+  }
+
+  ImGui::SameLine();
+  if (mCurrentMatch)
+  {
+    ImGui::Text("%zu/%zu", *mCurrentMatch + 1, mMatches.size());
+  }
+  else
+  {
+    ImGui::Text("%zu matches", mMatches.size());
+  }
+
+  const auto searchedOffset =
+    std::max(mpSearch->searchedOffset(), mText.startOffset());
+  if (searchedOffset < mText.endOffset())
+  {
+    ImGui::SameLine();
+    ImGui::TextDisabled(
+      "searching %d%%",
+      int((searchedOffset - mText.startOffset()) * 100 / mText.size()));
+  }
+}
+
+
+void View::drawSearchKeyboard()
+{
+  // Keys are buttons, which the d-pad moves between and A presses, same as
+  // for the other buttons.
+  static const char* const KEY_ROWS[][4] = {
+    {"1234567890", "qwertyuiop", "asdfghjkl:", "zxcvbnm._-"},
+    {"!@#$%^&*()", "QWERTYUIOP", "ASDFGHJKL;", "ZXCVBNM,/="}};
+
+  const auto keySize = ImVec2{ImGui::GetFrameHeight() * 1.5f, ImGui::GetFrameHeight()};
+  const auto append = [this](const char character)
+  {
+    const auto length = std::strlen(mSearchInput.data());
+    if (length + 1 < mSearchInput.size())
+    {
+      mSearchInput[length] = character;
+      mSearchInput[length + 1] = '\0';
+    }
+  };
+
+  ImGui::PushID("keyboard");
+  for (const auto pRow : KEY_ROWS[mKeyboardShifted])
+  {
+    for (auto pKey = pRow; *pKey != '\0'; ++pKey)
+    {
+      if (pKey != pRow)
+      {
+        ImGui::SameLine();
+      }
+
+      const char label[] = {*pKey, '\0'};
+      if (ImGui::Button(label, keySize))
+      {
+        append(*pKey);
+      }
+
+      // Start at the first key, highlighted as if the d-pad moved there.
+      if (mFocusKeyboard)
+      {
+        ImGui::SetFocusID(ImGui::GetItemID(), ImGui::GetCurrentWindow());
+        ImGui::GetCurrentContext()->NavDisableHighlight = false;
+        ImGui::GetCurrentContext()->NavDisableMouseHover = true;
+        mFocusKeyboard = false;
+      }
+    }
+  }
+
+  // Four of these are as wide as a row of ten keys.
+  const auto wideKeySize =
+    ImVec2{keySize.x * 2.5f + ImGui::GetStyle().ItemSpacing.x * 1.5f, keySize.y};
+
+  // Same ID either way, so that it keeps the focus
+  if (ImGui::Button(mKeyboardShifted ? "abc###shift" : "ABC###shift", wideKeySize))
+  {
+    mKeyboardShifted = !mKeyboardShifted;
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Space", wideKeySize))
+  {
+    append(' ');
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Delete", wideKeySize))
+  {
+    const auto length = std::strlen(mSearchInput.data());
+    if (length > 0)
+    {
+      mSearchInput[length - 1] = '\0';
+    }
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Done", wideKeySize))
+  {
+    mShowKeyboard = false;
+    mFocusText = true;
+  }
+
+  ImGui::PopID();
+}
+
+
+void View::selectMatch(const int direction)
+{
+  if (mMatches.empty() || activeLines().lineCount() == 0)
+  {
+    return;
+  }
+
+  if (mCurrentMatch)
+  {
+    mCurrentMatch =
+      (*mCurrentMatch + mMatches.size() + (direction > 0 ? 1 : -1)) %
+      mMatches.size();
+  }
+  else
+  {
+    // Continue from the top of the view
+    const auto topOffset = offsetForRow(topVisibleRow());
+    const auto iNext = std::lower_bound(mMatches.begin(), mMatches.end(), topOffset);
+    const auto next = std::size_t(std::distance(mMatches.begin(), iNext));
+    if (direction > 0)
+    {
+      mCurrentMatch = next < mMatches.size() ? next : 0;
+    }
+    else
+    {
+      mCurrentMatch = next > 0 ? next - 1 : mMatches.size() - 1;
+    }
+  }
+
+  scrollToCurrentMatch();
+}
+
+
+void View::scrollToCurrentMatch()
+{
+  // Put the match in the middle of the view
+  scrollToOffset(mMatches[*mCurrentMatch], 0.5f);
+}
+
+
+void View::applyPendingNavigation()
+{
+  const auto lineHeight = ImGui::GetTextLineHeight();
+  const auto rowCount = activeRowCount();
+
+  // Bookmarks are kept by line, so that they stay put when the wrap width
+  // changes.
+  if (mPendingBookmarkToggle && rowCount > 0)
+  {
+    const auto topRow = std::min(topVisibleRow(), rowCount - 1);
+    const auto line = mWrapLines ? activeLayout().lineForRow(topRow) : topRow;
+    const auto offset = activeLines().lineStart(line);
+    const auto iBookmark = std::lower_bound(mBookmarks.begin(), mBookmarks.end(), offset);
+    if (iBookmark != mBookmarks.end() && *iBookmark == offset)
+    {
+      mBookmarks.erase(iBookmark);
+    }
+    else
+    {
+      mBookmarks.insert(iBookmark, offset);
+    }
+  }
+
+  mPendingBookmarkToggle = false;
+
+  // None of these need to look at more than a single line, so they cost
+  // the same no matter how long the text is. All rows have the same
+  // height, so a row's position is just its index times the line height.
+  const auto scrollY = ImGui::GetScrollY();
+  const auto scrollMaxY = ImGui::GetScrollMaxY();
+  std::optional<float> targetY;
+
+  // Scrubbing moves by less than a row per frame in short texts, which
+  // snapping would undo.
+  const auto snapToRow = mPendingScrub == 0.0f;
+
+  // While indexing, the rows shown are only a part of the text.
+  const auto& lines = activeLines();
+  const auto shownSize = lines.indexedSize() - lines.lineStart(0);
+
+  if (mPendingBookmarkJump != 0 && !mBookmarks.empty() && rowCount > 0)
+  {
+    // The bookmark at the top of the view is the current one.
+    const auto topRow = std::min(topVisibleRow(), rowCount - 1);
+    const auto topLine = mWrapLines ? activeLayout().lineForRow(topRow) : topRow;
+    const auto topOffset = activeLines().lineStart(topLine);
+
+    auto iBookmark = mBookmarks.begin();
+    if (mPendingBookmarkJump > 0)
+    {
+      iBookmark = std::upper_bound(mBookmarks.begin(), mBookmarks.end(), topOffset);
+      if (iBookmark == mBookmarks.end())
+      {
+        iBookmark = mBookmarks.begin();
+      }
+    }
+    else
+    {
+      iBookmark = std::lower_bound(mBookmarks.begin(), mBookmarks.end(), topOffset);
+      iBookmark = iBookmark == mBookmarks.begin()
+        ? std::prev(mBookmarks.end())
+        : std::prev(iBookmark);
+    }
+
+    scrollToOffset(*iBookmark, 0.0f);
+  }
+  else if (mPendingFraction)
+  {
+    if (mpLineIndexer)
+    {
+      // Rows beyond the indexed part aren't known yet, so this goes by
+      // bytes instead.
+      scrollToOffset(
+        mText.startOffset() + std::uint64_t(double(*mPendingFraction) * mText.size()),
+        *mPendingFraction >= 1.0f ? 1.0f : 0.0f);
+    }
+    else if (*mPendingFraction >= 1.0f)
+    {
+      mScrollToEnd = true;
+    }
+    else
+    {
+      targetY = *mPendingFraction * scrollMaxY;
+    }
+  }
+  else if (mPendingPages != 0 || mPendingScrub != 0.0f)
+  {
+    // Keep one line of the previous page in view, for context.
+    const auto pageHeight = std::max(
+      lineHeight, ImGui::GetWindowHeight() - ImGui::GetStyle().WindowPadding.y * 2.0f - lineHeight);
+    const auto scrubScale = mpLineIndexer && shownSize > 0
+      ? float(double(mText.size()) / shownSize)
+      : 1.0f;
+    targetY =
+      scrollY + mPendingPages * pageHeight + mPendingScrub * scrubScale * scrollMaxY;
+  }
+
+  mPendingBookmarkJump = 0;
+  mPendingFraction.reset();
+  mPendingPages = 0;
+  mPendingScrub = 0.0f;
+
+  // Beyond the rows shown while indexing, the offset to go to is estimated
+  // from the number of bytes per row in those.
+  if (
+    targetY &&
+    mpLineIndexer &&
+    rowCount > 0 &&
+    ((*targetY < 0.0f && lines.lineStart(0) > mText.startOffset()) ||
+     (*targetY > scrollMaxY && lines.indexedSize() < mText.endOffset())))
+  {
+    const auto bytesPerPixel = double(shownSize) / (rowCount * lineHeight);
+    const auto offset = std::clamp(
+      double(offsetForRow(topVisibleRow())) + (*targetY - scrollY) * bytesPerPixel,
+      double(mText.startOffset()),
+      double(mText.endOffset()));
+    scrollToOffset(std::uint64_t(offset), 0.0f);
+  }
+  else if (targetY)
+  {
+    // Snap to whole rows, so that text doesn't end up cut off at the top.
+    const auto y = std::clamp(*targetY, 0.0f, scrollMaxY);
+    ImGui::SetScrollY(snapToRow ? std::floor(y / lineHeight) * lineHeight : y);
+    mScrollToEnd = false;
+  }
+}
+
+
+void View::scrollToOffset(
+  const std::uint64_t offset,
+  const float alignment,
+  const float shift)
+{
+  // Offsets which aren't indexed yet are shown by seeking, or in the seek
+  // window if that covers them already.
+  const auto isIndexed = !mpLineIndexer || offset < mLineIndex.indexedSize();
+  const auto isInSeekWindow =
+    mIsSeeking &&
+    offset >= mSeekLines.lineStart(0) &&
+    offset < mSeekLines.indexedSize();
+  if (isIndexed && !isInSeekWindow && mIsSeeking)
+  {
+    mIsSeeking = false;
+    mTextLayer.invalidate();
+  }
+  else if (!isIndexed && !isInSeekWindow)
+  {
+    seek(offset);
+  }
+
+  mPendingScroll = PendingScroll{offset, alignment, shift};
+  mScrollToEnd = false;
+}
+
+
+void View::seek(const std::uint64_t offset)
+{
+  // How many lines come before the offset isn't known, so the window
+  // starts after the first newline found in front of it, like tail does.
+  // Within a line that's too long for that, it starts in the middle.
+  const auto textBegin = mText.startOffset();
+  auto begin = offset - std::min(offset - textBegin, SEEK_WINDOW_SIZE / 2);
+  if (begin > textBegin)
+  {
+    const auto range = mText.range(
+      begin - 1,
+      std::min(begin + SEEK_WINDOW_SIZE / 4, mText.endOffset() - 1));
+    const auto pNewline =
+      static_cast<const char*>(std::memchr(range.data(), '\n', range.size()));
+    if (pNewline)
+    {
+      begin += std::uint64_t(pNewline - range.data());
+    }
+  }
+
+  mSeekLines.clear();
+  mSeekLines.discardBefore(begin);
+  mSeekLines.extend(mText, begin + SEEK_WINDOW_SIZE);
+  mSeekLayout.invalidate();
+  mTextLayer.invalidate();
+  mIsSeeking = true;
+}
+
+
+void View::applyPendingScroll()
+{
+  // Back to the main index once it covers the seek window, or indexing
+  // stopped, at the same position.
+  if (
+    mIsSeeking &&
+    !mPendingScroll &&
+    mpScrollArea &&
+    (!mpLineIndexer || mLineIndex.indexedSize() >= mSeekLines.indexedSize()))
+  {
+    const auto lineHeight = ImGui::GetTextLineHeight();
+    const auto scrollY = mpScrollArea->Scroll.y;
+    const auto topRow = std::size_t(scrollY / lineHeight);
+    mPendingScroll = PendingScroll{offsetForRow(topRow), 0.0f, scrollY - topRow * lineHeight};
+    mIsSeeking = false;
+    mTextLayer.invalidate();
+  }
+
+  if (!mPendingScroll || !mpScrollArea)
+  {
+    return;
+  }
+
+  const auto [offset, alignment, shift] = *mPendingScroll;
+  mPendingScroll.reset();
+
+  const auto& lines = activeLines();
+  if (lines.lineCount() == 0)
+  {
+    return;
+  }
+
+  // The layout is brought up to date again while drawing, with the same
+  // width unless that changed.
+  if (mWrapLines)
+  {
+    (mIsSeeking ? mSeekLayout : mWrapLayout).update(
+      mText, lines, ImGui::GetFont(), ImGui::GetFontSize(), mWrapWidth);
+  }
+
+  const auto line = lines.lineForOffset(offset);
+  const auto row = mWrapLines
+    ? activeLayout().rowForOffset(lines, line, offset)
+    : line;
+
+  // The rows are only submitted later in this frame. Without knowing their
+  // height up front, ImGui would clamp the scroll position to the height of
+  // the rows of the last frame.
+  const auto lineHeight = ImGui::GetTextLineHeight();
+  ImGui::SetNextWindowContentSize({0.0f, activeRowCount() * lineHeight});
+  ImGui::SetScrollY(
+    mpScrollArea,
+    std::max(
+      0.0f,
+      row * lineHeight - alignment * (mpScrollArea->Size.y - lineHeight) + shift));
+}
+
+
+void View::moveSeekWindow()
+{
+  // Other scrolling takes effect next frame, and moves the window itself
+  // if needed.
+  if (!mIsSeeking || mPendingScroll || ImGui::GetCurrentWindow()->ScrollTarget.y < FLT_MAX)
+  {
+    return;
+  }
+
+  // Seek again before reaching either end of the window, keeping the same
+  // text at the top of the view.
+  const auto lineHeight = ImGui::GetTextLineHeight();
+  const auto scrollY = ImGui::GetScrollY();
+  const auto topRow = topVisibleRow();
+  const auto visibleRows = std::size_t(ImGui::GetWindowHeight() / lineHeight) + 1;
+  const auto isNearStart =
+    topRow < visibleRows && mSeekLines.lineStart(0) > mText.startOffset();
+  const auto isNearEnd =
+    topRow + 2 * visibleRows > activeRowCount() &&
+    mSeekLines.indexedSize() < mText.endOffset();
+  if (isNearStart || isNearEnd)
+  {
+    const auto offset = offsetForRow(topRow);
+    seek(offset);
+    mPendingScroll = PendingScroll{offset, 0.0f, scrollY - topRow * lineHeight};
+  }
+}
+
+
+void View::drawBookmarks(const ImVec2& origin)
+{
+  if (mBookmarks.empty())
+  {
+    return;
+  }
+
+  // Only bookmarks on visible lines need to be looked at.
+  const auto rowCount = activeRowCount();
+  const auto lineHeight = ImGui::GetTextLineHeight();
+  const auto firstRow = std::min(rowCount, topVisibleRow());
+  const auto lastRow = std::min(
+    rowCount,
+    std::size_t((ImGui::GetScrollY() + ImGui::GetWindowHeight()) / lineHeight) + 1);
+  if (firstRow >= lastRow)
+  {
+    return;
+  }
+
+  const auto firstLine = mWrapLines ? activeLayout().lineForRow(firstRow) : firstRow;
+  const auto lastLine = mWrapLines ? activeLayout().lineForRow(lastRow - 1) : lastRow - 1;
+
+  // A bar in the window padding, left of the text
+  const auto pDrawList = ImGui::GetWindowDrawList();
+  const auto color = ImGui::GetColorU32(ImGuiCol_CheckMark);
+  const auto x1 = ImGui::GetWindowPos().x;
+  const auto x2 = x1 + ImGui::GetStyle().WindowPadding.x / 2.0f;
+  for (
+    auto iBookmark = std::lower_bound(
+      mBookmarks.begin(), mBookmarks.end(), activeLines().lineStart(firstLine));
+    iBookmark != mBookmarks.end() && *iBookmark <= activeLines().lineStart(lastLine);
+    ++iBookmark)
+  {
+    const auto y = origin.y + rowForLine(activeLines().lineForOffset(*iBookmark)) * lineHeight;
+    pDrawList->AddRectFilled({x1, y}, {x2, y + lineHeight}, color);
+  }
+}
+
+
+std::size_t View::topVisibleRow() const
+{
+  return std::size_t(ImGui::GetScrollY() / ImGui::GetTextLineHeight());
+}
+
+
+std::uint64_t View::offsetForRow(const std::size_t row) const
+{
+  if (row >= activeRowCount())
+  {
+    return activeLines().indexedSize();
+  }
+
+  if (mWrapLines)
+  {
+    const auto line = activeLayout().lineForRow(row);
+    return activeLayout().rowRange(activeLines(), line, row).first;
+  }
+
+  return activeLines().lineStart(row);
+}
+
+
+std::size_t View::rowForLine(const std::size_t line) const
+{
+  return mWrapLines ? activeLayout().firstRow(line) : line;
+}
+
+
+bool View::fetchScriptOutput()
+{
+  // Check this before picking up data, so that we don't miss anything the
+  // reader threads stored right before they finished.
+  const auto readersFinished =
+    mpScriptReader->isFinished() &&
+    (!mpScriptErrorReader || mpScriptErrorReader->isFinished());
+
+  // Pick up whatever the reader threads got from the script's output since
+  // the last frame, and append it to our text buffer. There's no telling
+  // how writes to stdout and stderr were interleaved within that time.
+  // Text in another encoding is converted and escape sequences are stripped
+  // here, once, with their colors turned into style spans. Text without a
+  // color keeps the stream's style.
+  // UTF-8 is checked last, since stripping escape sequences can cut a
+  // character in two.
+  const auto appendStyled = [this](const StyleId style)
+  {
+    return [this, style](const char* pBegin, const char* pEnd)
+    {
+      const auto length = std::size_t(pEnd - pBegin);
+      mStyleSpans.append(mText.endOffset(), length, style);
+      mText.append(pBegin, length);
+    };
+  };
+  const auto appendText = [&appendStyled](
+    AnsiParser& parser,
+    Utf8Sanitizer& sanitizer,
+    const StyleId streamStyle)
+  {
+    return [&appendStyled, &parser, &sanitizer, streamStyle](
+      const char* pText,
+      const char* pTextEnd)
+    {
+      parser.parse(
+        pText,
+        pTextEnd,
+        [&](const char* pBegin, const char* pEnd, const StyleId style)
+        {
+          sanitizer.sanitize(pBegin, pEnd, appendStyled(style != 0 ? style : streamStyle));
+        });
+    };
+  };
+  const auto appendOutput = [&appendText](
+    TextDecoder& decoder,
+    AnsiParser& parser,
+    Utf8Sanitizer& sanitizer,
+    const StyleId streamStyle)
+  {
+    return [&decoder, emit = appendText(parser, sanitizer, streamStyle)](
+      const char* pData,
+      const std::size_t size)
+    {
+      decoder.decode(pData, size, emit);
+    };
+  };
+
+  const auto endOffset = mText.endOffset();
+  auto bytesAdded = mpScriptReader->consume(
+    appendOutput(mOutputDecoder, mOutputParser, mOutputSanitizer, 0));
+  if (mpScriptErrorReader)
+  {
+    bytesAdded += mpScriptErrorReader->consume(
+      appendOutput(
+        mErrorOutputDecoder, mErrorOutputParser, mErrorOutputSanitizer, STYLE_SCRIPT_ERROR));
+  }
+
+  // A character cut off by the end of the output won't be completed.
+  if (readersFinished)
+  {
+    mOutputDecoder.finish(appendText(mOutputParser, mOutputSanitizer, 0));
+    mErrorOutputDecoder.finish(
+      appendText(mErrorOutputParser, mErrorOutputSanitizer, STYLE_SCRIPT_ERROR));
+    mOutputSanitizer.finish(appendStyled(0));
+    mErrorOutputSanitizer.finish(appendStyled(STYLE_SCRIPT_ERROR));
+  }
+
+  mBytesIngested += bytesAdded;
+  const auto textAdded = bytesAdded > 0 || mText.endOffset() != endOffset;
+  if (textAdded)
+  {
+    indexNewText();
+  }
+
+  if (readersFinished)
+  {
+    if (
+      mpScriptReader->hasFailed() ||
+      (mpScriptErrorReader && mpScriptErrorReader->hasFailed()))
+    {
+      // Error reading the pipe
+      throw std::runtime_error("Error read()-ing script fd");
+    }
+
+    // The script is done - close the pipe, and reap the process if it has
+    // exited already.
+    closeScriptPipe();
+    if (mpScript)
+    {
+      mpScript->exitStatus();
+    }
+  }
+
+  return textAdded;
+}
+
+
+bool View::fetchFollowedText()
+{
+  if (!mpFileFollower->checkForChanges())
+  {
+    return false;
+  }
+
+  auto changed = false;
+
+  // The file was rotated or truncated, start over with the new contents.
+  // Those are loaded the same way as the file's initial contents, and
+  // following resumes once they are indexed or converted.
+  if (mpFileFollower->reopenIfReplaced())
+  {
+    auto text = TextBuffer::mapFile(mpFileFollower->fd(), mMaxMappedSize);
+    mpFileFollower->skip(text.size());
+    mTextDecoder.reset();
+    mTextSanitizer.reset();
+    if (mTextDecoder.isConverting())
+    {
+      mText = TextBuffer{};
+      mpDecompressor = std::make_unique<Decompressor>(std::move(text), mOnProgress);
+    }
+    else
+    {
+      mText = std::move(text);
+    }
+
+    mUncheckedEnd = mText.endOffset();
+    applySizeLimit();
+
+    mLineIndex.clear();
+    if (!mpDecompressor)
+    {
+      indexLoadedText();
+    }
+
+    mStyleSpans.clear();
+    mWrapLayout.invalidate();
+    mBookmarks.clear();
+    changed = true;
+
+    if (mpSearch)
+    {
+      mMatches.clear();
+      mCurrentMatch.reset();
+      mpSearch->start(mpSearch->query());
+    }
+
+    // Text appended meanwhile has to wait for the new contents.
+    if (mpLineIndexer || mpDecompressor)
+    {
+      mpFileFollower->checkAgain();
+      return changed;
+    }
+  }
+
+  // Text appended to the file is mapped along with the rest of it, and
+  // read through range() like that. Only text which is converted, or
+  // wasn't mapped to begin with, is read and copied.
+  const auto endOffset = mText.endOffset();
+  auto bytesRead = std::uint64_t{0};
+  if (
+    !mTextDecoder.isConverting() &&
+    mpFileFollower->fd() != -1 &&
+    mText.extendMapping(mpFileFollower->fd(), mMaxMappedSize))
+  {
+    bytesRead = mText.endOffset() - endOffset;
+    mpFileFollower->skip(bytesRead);
+    mUncheckedEnd = mText.endOffset();
+  }
+  else
+  {
+    const auto appendValid = [this](const char* pBegin, const char* pEnd)
+    {
+      mText.append(pBegin, std::size_t(pEnd - pBegin));
+    };
+    const auto appendText = [&](const char* pBegin, const char* pEnd)
+    {
+      mTextSanitizer.sanitize(pBegin, pEnd, appendValid);
+    };
+    bytesRead = mpFileFollower->consume(
+      [&](const char* pData, const std::size_t size)
+      {
+        mTextDecoder.decode(pData, size, appendText);
+      });
+  }
+
+  mBytesIngested += bytesRead;
+  if (bytesRead > 0)
+  {
+    indexNewText();
+    changed = true;
+  }
+
+  return changed;
+}
+
+
+bool View::fetchDecompressedText()
+{
+  // Check this before picking up data, so that we don't miss anything the
+  // decompressor stored right before it finished.
+  const auto finished = mpDecompressor->isFinished();
+
+  const auto appendValid = [this](const char* pBegin, const char* pEnd)
+  {
+    mText.append(pBegin, std::size_t(pEnd - pBegin));
+  };
+  const auto appendText = [&](const char* pBegin, const char* pEnd)
+  {
+    mTextSanitizer.sanitize(pBegin, pEnd, appendValid);
+  };
+  const auto endOffset = mText.endOffset();
+  auto bytesAdded = mpDecompressor->consume(
+    [&](const char* pData, const std::size_t size)
+    {
+      mTextDecoder.decode(pData, size, appendText);
+    });
+  mBytesIngested += bytesAdded;
+
+  if (finished)
+  {
+    // A followed file's last character might still be in the process of
+    // being written.
+    if (!mpFileFollower)
+    {
+      mTextDecoder.finish(appendText);
+      mTextSanitizer.finish(appendValid);
+    }
+
+    // Show what we could decompress, followed by a note. Rotated logs can
+    // easily be cut short.
+    if (mpDecompressor->hasFailed())
+    {
+      const auto message = std::string{
+        "\n[Decompression failed - the file is truncated, corrupt, or uses "
+        "an unsupported format]\n"};
+      mStyleSpans.append(mText.endOffset(), message.size(), STYLE_SCRIPT_ERROR);
+      mText.append(message.data(), message.size());
+      bytesAdded += message.size();
+    }
+
+    mpDecompressor.reset();
+  }
+
+  const auto textAdded = bytesAdded > 0 || mText.endOffset() != endOffset;
+  if (textAdded)
+  {
+    indexNewText();
+  }
+
+  return textAdded || finished;
+}
+
+
+void View::applySizeLimit()
+{
+  // Unlike a mapped file, decompressed text occupies memory of its own, and
+  // there's no reading it back once discarded. So only the newest part is
+  // kept even without a limit.
+  if (mScrollbackLimits.maxBytes)
+  {
+    mText.setSizeLimit(*mScrollbackLimits.maxBytes);
+  }
+  else if (mpDecompressor)
+  {
+    mText.setSizeLimit(DEFAULT_DECOMPRESSED_SIZE_LIMIT);
+  }
+}
+
+
+void View::indexLoadedText()
+{
+  // Only the start of the text is indexed right away, so that it can be
+  // shown immediately, no matter how large it is.
+  mIndexingFailed = false;
+  mLineIndex.extend(mText, INITIAL_INDEX_SIZE);
+  if (mLineIndex.indexedSize() < mText.endOffset())
+  {
+    mpLineIndexer = std::make_unique<LineIndexer>(
+      mText, mLineIndex.indexedSize(), mOnProgress);
+  }
+}
+
+
+void View::indexNewText()
+{
+  // The text buffer might have dropped text to stay within its size limit.
+  auto linesDiscarded = mLineIndex.discardBefore(mText.startOffset());
+  mLineIndex.extend(mText);
+
+  const auto lineCount = mLineIndex.lineCount();
+  if (mScrollbackLimits.maxLines && lineCount > *mScrollbackLimits.maxLines)
+  {
+    mText.discardBefore(
+      mLineIndex.lineStart(lineCount - *mScrollbackLimits.maxLines));
+    linesDiscarded += mLineIndex.discardBefore(mText.startOffset());
+  }
+
+  mStyleSpans.discardBefore(mText.startOffset());
+
+  if (linesDiscarded > 0)
+  {
+    mRowsDiscarded += mWrapLines
+      ? mWrapLayout.discardLines(linesDiscarded)
+      : linesDiscarded;
+  }
+}
+
+
+std::pair<std::uint64_t, std::uint64_t> View::highlightedRange(
+  const std::uint64_t begin,
+  const std::uint64_t end) const
+{
+  if (!mCurrentMatch)
+  {
+    return {end, end};
+  }
+
+  const auto matchBegin = mMatches[*mCurrentMatch];
+  const auto matchEnd = matchBegin + mpSearch->query().size();
+  return {std::max(matchBegin, begin), std::min(matchEnd, end)};
+}
+
+
+void View::discardMatches()
+{
+  // Matches in text which was discarded can't be shown anymore. This can
+  // also affect matches found right before the text was discarded.
+  std::size_t matchesDiscarded = 0;
+  while (!mMatches.empty() && mMatches.front() < mText.startOffset())
+  {
+    mMatches.pop_front();
+    ++matchesDiscarded;
+  }
+
+  if (mCurrentMatch)
+  {
+    mCurrentMatch = *mCurrentMatch >= matchesDiscarded
+      ? std::optional<std::size_t>{*mCurrentMatch - matchesDiscarded}
+      : std::nullopt;
+  }
+}
+
+
+void View::closeScriptPipe()
+{
+    // Stop reading before the pipes go away. Standard input is left open.
+    mpScriptReader.reset();
+    mpScriptErrorReader.reset();
+
+    if (mpScript)
     {
-        pclose(mpScriptPipe);
-        mpScriptPipe = nullptr;
-        mScriptPipeFd = -1;
+        mpScript->closeOutput();
     }
 }
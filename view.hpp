@@ -21,36 +21,318 @@
 
 #pragma once
 
+#include "ansi_parser.hpp"
+#include "child_process.hpp"
+#include "decompressor.hpp"
+#include "file_follower.hpp"
+#include "font_atlas.hpp"
+#include "line_index.hpp"
+#include "line_indexer.hpp"
+#include "stream_reader.hpp"
+#include "style_spans.hpp"
+#include "text_buffer.hpp"
+#include "text_decoder.hpp"
+#include "text_layer.hpp"
+#include "text_search.hpp"
+#include "utf8.hpp"
+#include "wrap_layout.hpp"
+
 #include "imgui.h"
 
-#include <cstdio>
+#include <cstddef>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <string>
 #include <optional>
-#include <variant>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 
+struct ImGuiWindow;
+
+
+/** Where the text shown by a view comes from */
+enum class InputSource {
+  // Text given up front, e.g. a mapped file or a message
+  Text,
+  // Output of running the given script
+  ScriptFile,
+  // Text streamed from standard input
+  Stdin,
+  // A gzip or zstd compressed file, decompressed while being shown
+  CompressedFile
+};
+
+
+/** Bounds on how much text appended while running is kept. */
+struct ScrollbackLimits {
+  std::optional<std::size_t> maxLines;
+  std::optional<std::size_t> maxBytes;
+};
+
+
 class View {
 public:
   View(
     std::string windowTitle,
-    std::string inputTextOrScriptFile,
+    TextBuffer inputTextOrScriptFile,
     bool showYesNoButtons,
     bool wrapLines,
-    bool inpuTextIsScriptFile);
+    InputSource inputSource,
+    std::optional<StreamReader::Clock::duration> scriptReadBudget,
+    bool killScriptOnExit,
+    ScrollbackLimits scrollbackLimits,
+    std::size_t lineCacheSize,
+    std::size_t maxMappedSize,
+    const std::string& encoding,
+    std::function<void()> onScriptOutput,
+    std::unique_ptr<FileFollower> pFileFollower,
+    DynamicFontAtlas* pFontAtlas);
   ~View();
 
-  std::optional<int> draw(const ImVec2& windowSize);
+  /** Pick up new output from the script or standard input, newly
+    * decompressed text, or text appended to the followed file, if any.
+    *
+    * Returns true if there is new text to show.
+    */
+  bool update();
+
+  /** True if update() needs to be called regularly to notice new script
+    * output. Otherwise, the onScriptOutput callback given on construction is
+    * invoked (from another thread) when there is new output.
+    */
+  bool needsPolling() const
+  {
+    return mpScriptReader && mpScriptReader->needsPolling();
+  }
+
+  /** True while text is still being read, decompressed or indexed. */
+  bool isLoading() const
+  {
+    return mpScriptReader || mpDecompressor || mpLineIndexer;
+  }
+
+  /** Draw the view's window. drawTabs is called right after the window
+    * begins, to show tabs for switching between views.
+    */
+  std::optional<int> draw(
+    const ImVec2& windowSize,
+    const std::function<void()>& drawTabs = {});
+
+  /** The script's exit status, once it has finished. */
+  std::optional<int> scriptExitStatus();
+
+  /** Must be called when the font changed in a way not visible through the
+    * font's address or size, e.g. after rebuilding the font atlas.
+    */
+  void invalidateLayout()
+  {
+    mWrapLayout.invalidate();
+    mSeekLayout.invalidate();
+    mTextLayer.invalidate();
+  }
+
+  /** Free caches which are rebuilt when needed, like the layout, while the
+    * view isn't shown. Mapped text is read from disk again.
+    */
+  void releaseCaches();
+
+  /** Show the search input and give it keyboard focus. Without a
+    * keyboard, an on-screen one is shown below it instead, to type the
+    * query with the d-pad.
+    */
+  void openSearch(bool onScreenKeyboard);
+
+  /** Scroll to the next (direction > 0) or previous match of the search
+    * query. Without a current match, this picks the first one after or
+    * before the top of the view.
+    */
+  void jumpToMatch(int direction);
+
+  bool hasSearchMatches() const { return !mMatches.empty(); }
+
+  /** Scroll down (pages > 0) or up by the given number of screens. */
+  void scrollPages(int pages);
+
+  /** Scroll to the given position, from 0 (start) to 1 (end of the text).
+    * Scrolling to the end keeps following new text.
+    */
+  void scrollToFraction(float fraction);
+
+  /** Scroll by the given fraction of the text's height. */
+  void scrollByFraction(float fraction);
+
+  /** Bookmark the line at the top of the view, or remove the bookmark
+    * if it already has one.
+    */
+  void toggleBookmark();
+
+  /** Scroll to the next (direction > 0) or previous bookmark, starting
+    * from the top of the view and wrapping around.
+    */
+  void jumpToBookmark(int direction);
+
+  /** Total bytes of script output, standard input, decompressed or
+    * followed text received so far.
+    */
+  std::uint64_t bytesIngested() const { return mBytesIngested; }
+
+  /** Rows of text handed to ImGui for drawing in the last frame. Rows
+    * kept from earlier frames by the text layer don't count.
+    */
+  std::size_t rowsSubmitted() const { return mRowsSubmitted; }
 
 private:
+  void drawText(std::uint64_t begin, std::uint64_t end);
+  float addTextGeometry(
+    ImDrawList& drawList,
+    const ImVec2& position,
+    std::uint64_t begin,
+    std::uint64_t end);
+  bool drawTextLayer();
+  bool buildTextLayer(std::size_t firstRow, std::size_t lastRow, std::size_t minLastRow);
+  void drawLines();
+  void drawWrappedLines();
+  void prefetchAround(std::size_t firstLine, std::size_t lastLine);
+  void drawSearchBar();
+  void drawSearchKeyboard();
+  void selectMatch(int direction);
+  void scrollToCurrentMatch();
+  void applyPendingNavigation();
+  void scrollToOffset(std::uint64_t offset, float alignment, float shift = 0.0f);
+  void seek(std::uint64_t offset);
+  void applyPendingScroll();
+  void moveSeekWindow();
+  void drawBookmarks(const ImVec2& origin);
+  std::size_t topVisibleRow() const;
+  std::uint64_t offsetForRow(std::size_t row) const;
+  std::size_t rowForLine(std::size_t line) const;
   bool fetchScriptOutput();
+  bool fetchFollowedText();
+  bool fetchDecompressedText();
+  void applySizeLimit();
+  void indexLoadedText();
+  void indexNewText();
+  std::pair<std::uint64_t, std::uint64_t> highlightedRange(
+    std::uint64_t begin,
+    std::uint64_t end) const;
+  void discardMatches();
   void closeScriptPipe();
 
+  /** The lines shown, and their layout */
+  const LineIndex& activeLines() const { return mIsSeeking ? mSeekLines : mLineIndex; }
+  const WrapLayout& activeLayout() const { return mIsSeeking ? mSeekLayout : mWrapLayout; }
+  std::size_t activeRowCount() const
+  {
+    return mWrapLines ? activeLayout().rowCount() : activeLines().lineCount();
+  }
+
   std::string mTitle;
-  std::variant<std::string, std::vector<std::string>> mText;
-  FILE* mpScriptPipe;
-  int mScriptPipeFd;
+  TextBuffer mText;
+  LineIndex mLineIndex;
+  std::unique_ptr<LineIndexer> mpLineIndexer;
+  bool mIndexingFailed = false;
+  StyleSpans mStyleSpans;
+  WrapLayout mWrapLayout;
+  float mWrapWidth = 0.0f;
+
+  // While the text is still being indexed, a part of it beyond what's
+  // indexed so far can be shown by indexing only the text around it. This
+  // is shown instead of the main index until that has caught up.
+  LineIndex mSeekLines;
+  WrapLayout mSeekLayout;
+  bool mIsSeeking = false;
+
+  // Geometry of the rows around the visible ones, and everything besides
+  // the text that it depends on.
+  TextLayer mTextLayer;
+  std::tuple<std::size_t, std::uint64_t, float, float> mTextLayerKey;
+
+  ScrollbackLimits mScrollbackLimits;
+
+  // For mapping the followed file again when it's replaced
+  std::size_t mMaxMappedSize;
+
+  std::unique_ptr<ChildProcess> mpScript;
+  std::unique_ptr<StreamReader> mpScriptReader;
+  std::unique_ptr<StreamReader> mpScriptErrorReader;
+  AnsiParser mOutputParser;
+  AnsiParser mErrorOutputParser;
+
+  // Convert text from the encoding given on the command line as it
+  // arrives, and replace invalid UTF-8 in it. Text in memory of our own is
+  // only checked once like that. Only mapped text, which can't be changed,
+  // is checked right before it's drawn, in a copy of the row.
+  TextDecoder mOutputDecoder;
+  TextDecoder mErrorOutputDecoder;
+  TextDecoder mTextDecoder;
+  Utf8Sanitizer mOutputSanitizer;
+  Utf8Sanitizer mErrorOutputSanitizer;
+  Utf8Sanitizer mTextSanitizer;
+  std::unique_ptr<FileFollower> mpFileFollower;
+  std::unique_ptr<Decompressor> mpDecompressor;
+  DynamicFontAtlas* mpFontAtlas;
+
+  // Text before this offset came straight from a file, and might not be
+  // valid UTF-8.
+  std::uint64_t mUncheckedEnd = 0;
+
+  // Copy of the row being drawn, if it isn't valid UTF-8
+  std::string mSanitizedText;
+
+  // Wakes up the UI thread when other threads made progress
+  std::function<void()> mOnProgress;
+
+  // Created once search is first used
+  std::unique_ptr<TextSearch> mpSearch;
+  std::array<char, 256> mSearchInput{};
+  std::deque<std::uint64_t> mMatches;
+  std::optional<std::size_t> mCurrentMatch;
+  int mPendingJump = 0;
+  bool mFocusSearchInput = false;
+  bool mShowKeyboard = false;
+  bool mFocusKeyboard = false;
+  bool mKeyboardShifted = false;
+  bool mFocusText = false;
+
+  // Navigation requested between frames. Like jumping to a match, this
+  // needs the layout of the current frame, so it happens while drawing.
+  int mPendingPages = 0;
+  float mPendingScrub = 0.0f;
+  std::optional<float> mPendingFraction;
+  int mPendingBookmarkJump = 0;
+  bool mPendingBookmarkToggle = false;
+
+  // Scroll position to take on at the start of the next frame, once the
+  // rows it refers to are known: the row containing offset, at alignment
+  // (from 0 for the top to 1 for the bottom) of the view's height, moved
+  // down by shift.
+  struct PendingScroll {
+    std::uint64_t offset;
+    float alignment;
+    float shift;
+  };
+  std::optional<PendingScroll> mPendingScroll;
+
+  // Sorted offsets of bookmarked lines' starts
+  std::vector<std::uint64_t> mBookmarks;
 
   std::optional<int> mExitCode;
   bool mShowYesNoButtons;
+  bool mWrapLines;
+  bool mScrollToEnd = false;
+  bool mIsScrolledToEnd = true;
+  std::size_t mFirstVisibleLine = 0;
+
+  // Rows dropped at the top since the last frame, which the scroll position
+  // needs to be corrected by.
+  std::size_t mRowsDiscarded = 0;
+
+  std::uint64_t mBytesIngested = 0;
+  std::size_t mRowsSubmitted = 0;
+  ImGuiWindow* mpScrollArea = nullptr;
 };
@@ -0,0 +1,221 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#include "wrap_layout.hpp"
+
+#include "utf8.hpp"
+
+#include "imgui.h"
+#include "imgui_internal.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+namespace
+{
+
+// Initial amount of a line with invalid UTF-8 to copy for wrapping a row
+constexpr auto MIN_SANITIZED_PIECE_SIZE = std::size_t{1024};
+
+}
+
+
+void WrapLayout::update(
+  const TextBuffer& text,
+  const LineIndex& lineIndex,
+  const ImFont* pFont,
+  const float fontSize,
+  const float wrapWidth)
+{
+  if (pFont != mpFont || fontSize != mFontSize || wrapWidth != mWrapWidth)
+  {
+    invalidate();
+    mpFont = pFont;
+    mFontSize = fontSize;
+    mWrapWidth = wrapWidth;
+  }
+
+  auto linesDone = mFirstRows.size() - 1;
+  if (
+    linesDone > lineIndex.lineCount() ||
+    (linesDone > 0 && lineIndex.lineStart(0) != mFirstLineStart))
+  {
+    invalidate();
+    linesDone = 0;
+  }
+
+  if (linesDone == lineIndex.lineCount() && lineIndex.indexedSize() == mLaidOutSize)
+  {
+    return;
+  }
+
+  // The last line we laid out might have been incomplete, and received more
+  // text since. Redo it along with the new ones.
+  if (linesDone > 0)
+  {
+    --linesDone;
+    mFirstRows.pop_back();
+    mRowOffsets.resize(firstRow(linesDone));
+  }
+
+  const auto scale = fontSize / pFont->FontSize;
+  for (auto line = linesDone; line < lineIndex.lineCount(); ++line)
+  {
+    const auto range =
+      text.range(lineIndex.lineStart(line), lineIndex.lineEnd(line));
+    layoutLine(range.data(), range.data() + range.size(), scale);
+  }
+
+  mLaidOutSize = lineIndex.indexedSize();
+  mFirstLineStart = lineIndex.lineCount() > 0 ? lineIndex.lineStart(0) : 0;
+}
+
+
+void WrapLayout::invalidate()
+{
+  mFirstRows.assign(1, 0);
+  mRowOffsets.clear();
+  mLaidOutSize = 0;
+  mFirstLineStart = 0;
+}
+
+
+std::size_t WrapLayout::discardLines(const std::size_t count)
+{
+  // Lines which weren't laid out yet don't have any rows to drop.
+  const auto linesDone = mFirstRows.size() - 1;
+  if (count >= linesDone)
+  {
+    const auto rowsDiscarded = rowCount();
+    invalidate();
+    return rowsDiscarded;
+  }
+
+  const auto rowsDiscarded = firstRow(count);
+  mRowOffsets.erase(mRowOffsets.begin(), mRowOffsets.begin() + rowsDiscarded);
+  mFirstRows.erase(mFirstRows.begin(), mFirstRows.begin() + count);
+  return rowsDiscarded;
+}
+
+
+std::size_t WrapLayout::lineForRow(const std::size_t row) const
+{
+  // Every line has at least one row, so first rows are strictly increasing.
+  const auto iNext = std::upper_bound(
+    mFirstRows.begin(), std::prev(mFirstRows.end()), row + mFirstRows.front());
+  return std::distance(mFirstRows.begin(), iNext) - 1;
+}
+
+
+std::size_t WrapLayout::rowForOffset(
+  const LineIndex& lineIndex,
+  const std::size_t line,
+  const std::uint64_t offset) const
+{
+  const auto lineOffset = offset - std::min(offset, lineIndex.lineStart(line));
+  const auto iFirst = mRowOffsets.begin() + firstRow(line);
+  const auto iNext = std::upper_bound(
+    std::next(iFirst),
+    mRowOffsets.begin() + firstRow(line + 1),
+    lineOffset);
+  return std::distance(mRowOffsets.begin(), iNext) - 1;
+}
+
+
+std::pair<std::uint64_t, std::uint64_t> WrapLayout::rowRange(
+  const LineIndex& lineIndex,
+  const std::size_t line,
+  const std::size_t row) const
+{
+  const auto lineStart = lineIndex.lineStart(line);
+  const auto rowStart = lineStart + mRowOffsets[row];
+  const auto rowEnd = row + 1 < firstRow(line + 1)
+    ? lineStart + mRowOffsets[row + 1]
+    : lineIndex.lineEnd(line);
+  return {rowStart, rowEnd};
+}
+
+
+void WrapLayout::layoutLine(
+  const char* pLineStart,
+  const char* pLineEnd,
+  const float scale)
+{
+  // This follows the wrapping done by ImFont::RenderText() and
+  // CalcTextSizeA(), so that the result looks the same as TextWrapped().
+  mRowOffsets.push_back(0);
+
+  const auto isValid = isValidUtf8(pLineStart, pLineEnd);
+  auto pRow = pLineStart;
+  while (pRow < pLineEnd)
+  {
+    auto pRowEnd = isValid
+      ? mpFont->CalcWordWrapPositionA(scale, pRow, pLineEnd, mWrapWidth)
+      : sanitizedWrapPosition(pRow, pLineEnd, scale);
+
+    // Wrap width is too small to fit anything. Force one character per row.
+    if (pRowEnd == pRow)
+    {
+      unsigned int codepoint;
+      pRowEnd += std::max(ImTextCharFromUtf8(&codepoint, pRow, pLineEnd), 1);
+    }
+
+    // Wrapping skips blanks at the start of the next row.
+    pRow = pRowEnd;
+    while (pRow < pLineEnd && (*pRow == ' ' || *pRow == '\t'))
+    {
+      ++pRow;
+    }
+
+    if (pRow < pLineEnd)
+    {
+      mRowOffsets.push_back(static_cast<std::uint32_t>(pRow - pLineStart));
+    }
+  }
+
+  mFirstRows.push_back(mFirstRows.front() + mRowOffsets.size());
+}
+
+
+const char* WrapLayout::sanitizedWrapPosition(
+  const char* pRow,
+  const char* pLineEnd,
+  const float scale)
+{
+  // Invalid UTF-8 is drawn as a sanitized copy of the same length, so it's
+  // wrapped like that as well. Only as much of the line as a row might
+  // take is copied, which is doubled until the row fits.
+  for (auto pieceSize = MIN_SANITIZED_PIECE_SIZE; ; pieceSize *= 2)
+  {
+    const auto pPieceEnd = std::size_t(pLineEnd - pRow) > pieceSize
+      ? pRow + pieceSize
+      : pLineEnd;
+    const auto pPiece = sanitizeUtf8(pRow, pPieceEnd, mSanitizedText);
+    const auto pPieceCopyEnd = pPiece + (pPieceEnd - pRow);
+    const auto pWrap = mpFont->CalcWordWrapPositionA(
+      scale, pPiece, pPieceCopyEnd, mWrapWidth);
+    if (pWrap < pPieceCopyEnd || pPieceEnd == pLineEnd)
+    {
+      return pRow + (pWrap - pPiece);
+    }
+  }
+}
@@ -0,0 +1,117 @@
+/** Copyright (c) 2021 Nikolai Wuttke
+  *
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in all
+  * copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  * SOFTWARE.
+  */
+
+#pragma once
+
+#include "line_index.hpp"
+#include "text_buffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+
+
+struct ImFont;
+
+
+/** Cached word-wrapping of an indexed text buffer.
+  *
+  * Stores where each line is broken into visual rows. Since all rows have
+  * the same height, the number of rows preceding a line doubles as a
+  * prefix sum of line heights, so mapping a scroll position to a line is a
+  * binary search. The layout only depends on wrap width and font, and is
+  * extended incrementally when lines are appended.
+  */
+class WrapLayout {
+public:
+  /** Bring the layout up to date with the given text.
+    *
+    * Drops the cached layout if wrap width or font changed, otherwise only
+    * lays out lines added since the last update.
+    */
+  void update(
+    const TextBuffer& text,
+    const LineIndex& lineIndex,
+    const ImFont* pFont,
+    float fontSize,
+    float wrapWidth);
+
+  void invalidate();
+
+  /** Drop the layout of the given number of lines at the front, after they
+    * were dropped from the line index. Returns the number of rows dropped.
+    */
+  std::size_t discardLines(std::size_t count);
+
+  std::size_t rowCount() const { return mRowOffsets.size(); }
+
+  /** Index of the line containing the given row */
+  std::size_t lineForRow(std::size_t row) const;
+
+  /** Index of the first row of the given line */
+  std::size_t firstRow(std::size_t line) const
+  {
+    return mFirstRows[line] - mFirstRows.front();
+  }
+
+  /** Index of the row of the given line which contains the given offset */
+  std::size_t rowForOffset(
+    const LineIndex& lineIndex,
+    std::size_t line,
+    std::uint64_t offset) const;
+
+  /** Text range of the given row, as offsets into the buffer */
+  std::pair<std::uint64_t, std::uint64_t> rowRange(
+    const LineIndex& lineIndex,
+    std::size_t line,
+    std::size_t row) const;
+
+private:
+  void layoutLine(
+    const char* pLineStart,
+    const char* pLineEnd,
+    float scale);
+  const char* sanitizedWrapPosition(
+    const char* pRow,
+    const char* pLineEnd,
+    float scale);
+
+  // First row of each line, plus the total number of rows at the end.
+  // Rows are counted from the start of the text, including discarded
+  // lines, so that dropping lines doesn't require updating all others.
+  std::deque<std::uint64_t> mFirstRows{0};
+
+  // Start of each row, relative to the start of its line.
+  std::deque<std::uint32_t> mRowOffsets;
+
+  // Lines only change at the front if they were partially discarded
+  std::uint64_t mFirstLineStart = 0;
+
+  const ImFont* mpFont = nullptr;
+  float mFontSize = 0.0f;
+  float mWrapWidth = -1.0f;
+  std::uint64_t mLaidOutSize = 0;
+
+  // Copy of the part of a line being wrapped, if it isn't valid UTF-8
+  std::string mSanitizedText;
+};